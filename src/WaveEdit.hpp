@@ -11,6 +11,9 @@
 #include <thread>
 #include <vector>
 #include <complex>
+#include <atomic>
+#include <memory>
+#include <functional>
 
 
 #define STRINGIFY(x) #x
@@ -77,6 +80,11 @@ inline float linterpf(const float *p, float x) {
 		return crossf(p[xi], p[xi + 1], xf);
 }
 
+/** Wraps an angle to [-pi, pi] */
+inline float wrapPhasef(float x) {
+	return x - 2 * M_PI * roundf(x / (2 * M_PI));
+}
+
 /** Returns a random number on [0, 1) */
 inline float randf() {
 	return (float)rand() / RAND_MAX;
@@ -94,10 +102,178 @@ inline void cmultf(float *cr, float *ci, float ar, float ai, float br, float bi)
 void RFFT(const float *in, float *out, int len);
 void IRFFT(const float *in, float *out, int len);
 
-int resample(const float *in, int inLen, float *out, int outLen, double ratio);
+enum ResampleQuality {
+	/** Interpolator for interactive previews */
+	RESAMPLE_CUBIC,
+	/** libsamplerate band-limited converters */
+	RESAMPLE_SINC_FASTEST,
+	RESAMPLE_SINC_MEDIUM,
+	RESAMPLE_SINC_BEST,
+	RESAMPLE_QUALITIES_LEN
+};
+
+extern const char *resampleQualityNames[RESAMPLE_QUALITIES_LEN];
+
+/** Returns the number of samples written to `out` */
+int resample(const float *in, int inLen, float *out, int outLen, double ratio, ResampleQuality quality = RESAMPLE_SINC_FASTEST);
+/** Returns the libsamplerate converter of a sinc tier, for streaming converters made with src_new() or src_callback_new() */
+int srcConverterType(ResampleQuality quality);
 void cyclicOversample(const float *in, float *out, int len, int oversample);
+/** Band-limited resampling of one cycle to any power-of-two length, by truncating or zero-padding its spectrum */
+void cyclicResample(const float *in, int inLen, float *out, int outLen);
+/** Allocates memory aligned for SIMD loads. Free with alignedFree() */
+void *alignedMalloc(size_t size);
+void alignedFree(void *ptr);
+
+// Fixed-length versions of the above, which reuse one FFT plan per length
+// Instantiated in math.cpp for power-of-two lengths from 128 to 2048, for oversampling 128-sample waves by 2, 4, 8 and 16, and for oversampling 256-sample waves by 4 and 8.
+
+template <int LEN>
+void RFFT(const float *in, float *out);
+template <int LEN>
+void IRFFT(const float *in, float *out);
+template <int LEN, int OVERSAMPLE>
+void cyclicOversample(const float *in, float *out);
+/** Inverse of cyclicOversample(), discarding harmonics above the Nyquist frequency of `LEN` */
+template <int LEN, int OVERSAMPLE>
+void cyclicDownsample(const float *in, float *out);
+
+
+////////////////////
+// pool.cpp
+////////////////////
+
+/** Tasks submitted to the process-wide work-stealing pool, which can be waited on together */
+struct TaskGroup {
+	std::atomic<int> pending;
+
+	TaskGroup() : pending(0) {}
+	/** Waits for the remaining tasks */
+	~TaskGroup();
+	void run(std::function<void()> work);
+	/** Runs the group's queued tasks on the calling thread, then sleeps until the ones running elsewhere are done */
+	void wait();
+};
+
+/** Number of threads which run tasks, counting the thread which waits */
+int poolThreads();
+/** Runs the queued tasks and joins the workers. Call at exit, after the jobs are destroyed. Tasks submitted afterwards run on the thread which waits on them. */
+void poolDestroy();
+/** Calls `work(i)` for each i in [begin, end) on the pool, returning when all calls are done */
+void parallelFor(int begin, int end, std::function<void(int)> work);
+
+enum ScratchSlot {
+	SCRATCH_FFT_WORK,
+	SCRATCH_SLOTS_LEN
+};
+
+/** Returns an aligned buffer of at least `len` floats owned by the calling thread
+Reused by the next call with the same slot on the same thread, so do not hold it across calls.
+*/
+float *threadScratch(ScratchSlot slot, int len);
+
+
+////////////////////
+// arena.cpp
+////////////////////
+
+/** Bump-allocates from the calling thread's arena
+The memory is released all at once by arenaReset(), or by the end of the enclosing ArenaScope. Never free it.
+Each pool task runs inside its own scope, so memory allocated by a task does not outlive it.
+*/
+void *arenaAlloc(size_t size, size_t align = 32);
+template <typename T>
+T *arenaArray(size_t len) {
+	return (T*) arenaAlloc(sizeof(T) * len);
+}
+/** Releases everything the calling thread has allocated. Must not be called inside an ArenaScope. */
+void arenaReset();
+/** Resets the UI thread's arena and records arenaFrameStats. Call once at the end of each frame. */
+void arenaFrameEnd();
+
+/** Releases the calling thread's arena allocations made during the scope's lifetime, for temporaries outside the UI frame */
+struct ArenaScope {
+	int block;
+	size_t offset;
+
+	ArenaScope();
+	~ArenaScope();
+};
+
+struct ArenaStats {
+	/** By all threads during the frame */
+	int allocations;
+	int64_t bytes;
+	/** Blocks the arenas had to take from the heap */
+	int heapAllocations;
+};
+
+/** Counts for the last complete frame */
+extern ArenaStats arenaFrameStats;
+
+
+////////////////////
+// convert.cpp
+////////////////////
+
+/** Sample format conversion loops, vectorized per instruction set like EffectKernels
+Integers are read as x / 2^(bits - 1) and written as round(x * (2^(bits - 1) - 1)), clamped to [-1, 1].
+`dither` is optional noise in LSBs added before rounding, as from tpdfDither().
+*/
+struct ConvertKernels {
+	const char *name;
+	void (*i16_to_f32)(const int16_t *in, float *out, int len);
+	/** Packed little-endian 3-byte samples */
+	void (*i24_to_f32)(const uint8_t *in, float *out, int len);
+	void (*i32_to_f32)(const int32_t *in, float *out, int len);
+	void (*f32_to_i16)(const float *in, int16_t *out, int len, const float *dither);
+	void (*f32_to_i24)(const float *in, uint8_t *out, int len, const float *dither);
+	void (*f32_to_i32)(const float *in, int32_t *out, int len);
+	/** Triangular noise on (-1, 1) from the counter `seed` + 2 i */
+	void (*tpdfDither)(float *noise, int len, uint32_t seed);
+};
+
+/** Fastest conversions supported by the CPU, selected on first use so static initializers can convert samples */
+const ConvertKernels *convertKernels();
+
 void i16_to_f32(const int16_t *in, float *out, int length);
-void f32_to_i16(const float *in, int16_t *out, int length);
+void i24_to_f32(const uint8_t *in, float *out, int length);
+void i32_to_f32(const int32_t *in, float *out, int length);
+void f32_to_i16(const float *in, int16_t *out, int length, const float *dither = NULL);
+void f32_to_i24(const float *in, uint8_t *out, int length, const float *dither = NULL);
+void f32_to_i32(const float *in, int32_t *out, int length);
+/** Fills `noise` with triangular noise on (-1, 1), advancing `seed` */
+void tpdfDither(float *noise, int length, uint32_t *seed);
+
+
+////////////////////
+// kernels.cpp
+////////////////////
+
+/** Pointwise effect loops, vectorized with polynomial approximations of sin() and asin()
+All operate in-place on `x` of length `len`.
+The loops are plain C++ which the compiler vectorizes for each instruction set, rather than intrinsics.
+*/
+struct EffectKernels {
+	/** Instruction set the kernels were compiled for */
+	const char *name;
+	void (*gain)(float *x, int len, float gain);
+	/** x = sin(n asin(x)), with out-of-range values folded by 1/x */
+	void (*chebyshev)(float *x, int len, float n);
+	void (*sampleAndHold)(float *x, int len, float frameskip);
+	void (*quantize)(float *x, int len, float levels);
+	/** Removes the linear trend between the first and last sample */
+	void (*cycle)(float *x, int len);
+	/** Rescales to [-1, 1], or zeros `x` if it is constant */
+	void (*normalize)(float *x, int len);
+	/** Hard clips to [-1, 1] */
+	void (*clip)(float *x, int len);
+};
+
+/** Fastest kernels supported by the CPU, selected on first use so static initializers can run effects */
+const EffectKernels *effectKernels();
+/** Kernels compiled for the baseline instruction set, for comparing against the selected ones */
+const EffectKernels *genericEffectKernels();
 
 
 ////////////////////
@@ -106,8 +282,14 @@ void f32_to_i16(const float *in, int16_t *out, int length);
 
 /** Opens a URL, also happens to work with PDFs */
 void openBrowser(const char *url);
-/** Caller must free(). Returns NULL if unsuccessful */
+/** Caller must delete[]. Returns NULL if unsuccessful
+Mixes all channels down to mono.
+*/
 float *loadAudio(const char *filename, int *length);
+/** Like loadAudio(), but keeps each channel in its own plane of `length` samples, so channel c starts at c * length */
+float *loadAudioPlanar(const char *filename, int *length, int *channels);
+/** Splits `frames` interleaved frames into `channels` planes spaced `planeLen` apart */
+void deinterleave(const float *in, int frames, int channels, float *planes, int planeLen);
 /** Converts a printf format to a std::string */
 std::string stringf(const char *format, ...);
 /** Truncates a string if needed, inserting ellipses (...), to be no greater than `maxLen` characters */
@@ -116,6 +298,16 @@ unsigned char *base64_encode(const unsigned char *src, size_t len, size_t *out_l
 unsigned char *base64_decode(const unsigned char *src, size_t len, size_t *out_len);
 
 
+////////////////////
+// wavreader.cpp
+////////////////////
+
+/** Reads 16, 24 and 32-bit PCM or 32-bit float WAV files straight from a memory map, in the planar layout of loadAudioPlanar()
+Returns NULL for anything else, which should be read with libsndfile instead.
+*/
+float *loadWAVMapped(const char *filename, int *length, int *channels);
+
+
 ////////////////////
 // wave.cpp
 ////////////////////
@@ -139,6 +331,17 @@ enum EffectID {
 };
 
 extern const char *effectNames[EFFECTS_LEN];
+/** Oversampling factor of the nonlinear effects and the hard clip: 1, 4 or 8
+Only applies to waves of up to 256 samples. Set by the UI thread while workers read it.
+*/
+extern std::atomic<int> effectOversample;
+
+/** Applies the effect chain to a wave of length LEN
+`effects` must be length EFFECTS_LEN.
+Instantiated in wave.cpp for LEN = 128, 256 and 2048.
+*/
+template <int LEN>
+void applyEffects(const float *in, float *out, const float *effects, bool cycle, bool normalize);
 
 struct Wave {
 	float samples[WAVE_LEN];
@@ -154,8 +357,15 @@ struct Wave {
 	float effects[EFFECTS_LEN];
 	bool cycle;
 	bool normalize;
+	/** Stamp from a global counter, replaced whenever the wave changes
+	Two waves with the same version have the same contents, even across undo, so caches can key on it.
+	Not saved to disk. Fields before it are the autosave record.
+	*/
+	uint32_t version;
 
 	void clear();
+	/** Assigns a new version and notifies the wave listeners. Called by every method which edits the wave. */
+	void bump();
 	/** Generates post arrays from the sample array, by applying effects */
 	void updatePost();
 	void commitSamples();
@@ -182,6 +392,15 @@ extern bool clipboardActive;
 #define BANK_GRID_WIDTH 11
 #define BANK_GRID_HEIGHT 3
 
+/** Called after a wave's version changes
+Waves are edited by worker threads too, so listeners must be thread-safe.
+*/
+typedef void (*WaveListener)(Wave *wave);
+
+/** Not thread-safe, call during initialization */
+void waveSubscribe(WaveListener listener);
+
+
 struct Bank {
 	Wave waves[BANK_LEN];
 
@@ -191,9 +410,22 @@ struct Bank {
 	/** `in` must be length BANK_LEN * WAVE_LEN */
 	void setSamples(const float *in);
 	void getPostSamples(float *out);
+	/** `out` must be length BANK_LEN * WAVE_LEN / 2 */
+	void getHarmonics(float *out);
+	/** Replaces the harmonic magnitudes of the waves with `changed` set, keeping their phases
+	`in` must be length BANK_LEN * WAVE_LEN / 2, and `changed` length BANK_LEN.
+	The changed waves are resynthesized together on the pool.
+	*/
+	void setHarmonics(const float *in, const bool *changed);
+	/** `out` must be length BANK_LEN */
+	void getEffect(EffectID effect, float *out);
 	void duplicateToAll(int waveId);
-	/** Binary dump of the bank struct */
-	void save(const char *filename);
+	/** Returns whether each wave has the same version as in `other` */
+	bool sameVersions(const Bank *other) const;
+	/** Binary dump of the waves, without versions
+	Returns true only if every write succeeded and the file was synced to the disk.
+	*/
+	bool save(const char *filename);
 	void load(const char *filename);
 	/** WAV file with BANK_LEN * WAVE_LEN samples */
 	void saveWAV(const char *filename);
@@ -202,6 +434,243 @@ struct Bank {
 	void saveWaves(const char *dirname);
 };
 
+/** Structure-of-arrays copy of a bank's post-effect data
+Passes across the whole bank, like morphing, read contiguous rows instead of striding over entire Wave structs.
+*/
+struct BankPlanes {
+	float postSamples[BANK_LEN][WAVE_LEN];
+	float postSpectrum[BANK_LEN][WAVE_LEN];
+	float postHarmonics[BANK_LEN][WAVE_LEN / 2];
+	/** Argument of each harmonic of postSpectrum */
+	float postPhases[BANK_LEN][WAVE_LEN / 2];
+	float effects[EFFECTS_LEN][BANK_LEN];
+	/** Wave versions the planes were loaded from */
+	uint32_t versions[BANK_LEN];
+	/** Incremented by load() when a wave changes, so cached frames can be invalidated */
+	int revision;
+
+	void load(Bank *bank);
+	/** Crossfades adjacent waves at position `z` on [0, BANK_LEN - 1]. `out` must be length WAVE_LEN */
+	void morphZ(float z, float *out);
+	/** Bilinearly interpolates the grid at position (`x`, `y`). `out` must be length WAVE_LEN */
+	void morphXY(float x, float y, float *out);
+	/** Like morphZ() but interpolates harmonic magnitudes and phases, then resynthesizes with an IRFFT
+	Partials glide between waves instead of cancelling each other out.
+	*/
+	void morphSpectralZ(float z, float *out);
+	void morphSpectralXY(float x, float y, float *out);
+};
+
+/** Fills the waves between keyframes by crossfading the keyframes' harmonic magnitudes
+`matrix` is BANK_LEN * WAVE_LEN / 2 magnitudes as from Bank::getHarmonics(). Sets `changed` for every filled wave.
+Waves before the first and after the last keyframe copy the nearest one.
+*/
+void interpolateKeyframes(float *matrix, const bool *keyframes, bool *changed);
+
+
+////////////////////
+// expr.cpp
+////////////////////
+
+/** Number of user parameters, named a, b, c and d in expressions */
+#define EXPR_PARAMS_LEN 4
+
+enum ExprOpcode {
+	// Leaves
+	EXPR_CONST,
+	EXPR_X,
+	EXPR_Z,
+	EXPR_W,
+	EXPR_PARAM,
+	// Unary
+	EXPR_NEG,
+	EXPR_SIN,
+	EXPR_COS,
+	EXPR_TAN,
+	EXPR_TANH,
+	EXPR_EXP,
+	EXPR_LOG,
+	EXPR_SQRT,
+	EXPR_ABS,
+	EXPR_FLOOR,
+	EXPR_CEIL,
+	EXPR_ROUND,
+	EXPR_FRACT,
+	EXPR_SIGN,
+	EXPR_SAW,
+	EXPR_SQR,
+	EXPR_TRI,
+	// Binary
+	EXPR_ADD,
+	EXPR_SUB,
+	EXPR_MUL,
+	EXPR_DIV,
+	EXPR_MOD,
+	EXPR_POW,
+	EXPR_MIN,
+	EXPR_MAX,
+	EXPR_ATAN2,
+	EXPR_LESS,
+	EXPR_GREATER,
+	// Ternary
+	EXPR_CLAMP,
+};
+
+struct ExprOp {
+	ExprOpcode code;
+	/** Value of EXPR_CONST, or index of EXPR_PARAM */
+	float value;
+};
+
+/** A formula over the bank, compiled to stack bytecode where each instruction processes a whole wave
+Variables are x, the phase on [0, 1) within the wave, z, the position on [0, 1] across the bank, w, the wave index, and the parameters a to d.
+*/
+struct Expr {
+	std::vector<ExprOp> ops;
+	/** Stack depth the program needs */
+	int stackLen = 0;
+	float params[EXPR_PARAMS_LEN] = {};
+
+	/** Returns false and describes the problem in `error` if `text` cannot be parsed, keeping the previous program */
+	bool compile(const char *text, std::string *error);
+	/** Evaluates the expression at every sample of the bank on the pool. `out` must be length BANK_LEN * WAVE_LEN */
+	void evaluate(float *out) const;
+};
+
+
+////////////////////
+// lattice.cpp
+////////////////////
+
+/** Number of spectrally morphed frames from one wave toward the next, in Z and in each direction of XY */
+#define LATTICE_STEPS 8
+
+/** Starts the thread which builds the morph lattice */
+void latticeInit();
+void latticeDestroy();
+/** Invalidates the lattice segments touching waves whose version changed since the last call. Call once per frame. */
+void latticeUpdate(Bank *bank);
+/** Interpolates the precomputed spectral morph at `z`
+Returns false if the lattice around `z` is still being built.
+Safe to call from the audio thread.
+*/
+bool latticeMorphZ(float z, float *out);
+bool latticeMorphXY(float x, float y, float *out);
+
+
+////////////////////
+// wavetable.cpp
+////////////////////
+
+/** Frame length and frame count of a wavetable format
+Geometry only applies to converting wavetables on import and export. The bank, audio engine and widgets work at WAVE_LEN x BANK_LEN throughout.
+*/
+struct WavetableGeometry {
+	const char *name;
+	int waveLen;
+	int bankLen;
+};
+
+/** The first entry is the MicroMonsta layout, WAVE_LEN x BANK_LEN */
+extern const WavetableGeometry wavetableGeometries[];
+extern const int wavetableGeometriesLen;
+
+/** Renders frame `j` of a `bankLen` frame wavetable into `out` */
+void renderWavetableFrame(BankPlanes *planes, int j, int bankLen, float *out, int waveLen);
+
+/** A wavetable of any geometry, for exchanging banks with other synths
+The editor always works on a Bank. Wavetables are rendered from it on export and converted back on import.
+*/
+struct Wavetable {
+	int waveLen = 0;
+	int bankLen = 0;
+	/** Aligned, `bankLen * waveLen` samples */
+	float *samples = NULL;
+
+	Wavetable() {}
+	Wavetable(const Wavetable &) = delete;
+	Wavetable &operator=(const Wavetable &) = delete;
+	~Wavetable();
+	/** Reallocates and zeros the sample array */
+	void resize(int waveLen, int bankLen);
+	/** Resamples the bank's post samples to this geometry
+	Each wave is upsampled through the band-limited cyclic path, and frames between waves are crossfaded.
+	*/
+	void renderBank(Bank *bank);
+	/** Resamples this wavetable back to WAVE_LEN x BANK_LEN and commits it to `bank` */
+	void toBank(Bank *bank);
+	/** Writes a 16-bit WAV with a cycle length chunk */
+	void saveWAV(const char *filename);
+	/** Reads consecutive frames of length `waveLen`, discarding a trailing partial frame
+	Returns false and leaves the wavetable empty if the file cannot be read or is shorter than one frame.
+	*/
+	bool loadWAV(const char *filename, int waveLen);
+};
+
+
+////////////////////
+// export.cpp
+////////////////////
+
+enum ExportFormat {
+	EXPORT_PCM16,
+	EXPORT_PCM24,
+	EXPORT_FLOAT,
+	EXPORT_FORMATS_LEN
+};
+
+extern const char *exportFormatNames[EXPORT_FORMATS_LEN];
+/** Sample format used by the export menu items */
+extern ExportFormat exportFormat;
+/** Adds TPDF dither to every 16-bit export */
+extern bool exportDither;
+
+struct ExportStats {
+	int files;
+	int64_t bytes;
+	double seconds;
+};
+
+int exportFormatBytes(ExportFormat format);
+/** Encodes mono samples as a complete WAV file in memory, so it can be written with a single fwrite */
+void encodeWAV(const float *samples, int len, int sampleRate, ExportFormat format, std::vector<uint8_t> &out);
+/** Returns false if the file could not be fully written */
+bool writeFile(const char *filename, const std::vector<uint8_t> &data);
+/** Encodes and writes each wave to `dirname/NN.wav` on worker threads */
+ExportStats exportWaves(Bank *bank, const char *dirname, ExportFormat format);
+/** Returns the sorted paths of the WAV files in a directory */
+std::vector<std::string> listBankFiles(const char *dirname);
+/** Re-encodes each bank file in `paths` on worker threads
+If `archive` is true, all banks are written to a single tar file at `outPath`, skipping names longer than 100 bytes. Otherwise `outPath` is a directory, and banks already in it are skipped rather than overwritten.
+*/
+ExportStats exportLibrary(const std::vector<std::string> &paths, const char *outPath, ExportFormat format, bool archive);
+
+/** Streams a mono wavetable to disk one frame at a time
+WAV files carry a `clm ` chunk with the cycle length, as written by Serum and read by Vital.
+Raw tables are headerless little-endian 32-bit float.
+*/
+struct WavetableWriter {
+	FILE *f = NULL;
+	ExportFormat format;
+	bool raw;
+	size_t headerSize;
+	size_t dataSize;
+	/** Carried between frames, so the dither does not repeat with the cycle length */
+	uint32_t ditherSeed;
+	/** Reused for each write() */
+	std::vector<uint8_t> buffer;
+
+	bool open(const char *filename, int cycleLen, ExportFormat format, bool raw);
+	void write(const float *samples, int len);
+	/** Patches the chunk sizes. Returns false if any write failed */
+	bool close();
+};
+
+/** Renders and streams the bank at the given geometry. Returns the number of bytes written, or 0 on failure */
+int64_t exportWavetable(Bank *bank, const char *filename, WavetableGeometry geometry, ExportFormat format, bool raw);
+/** Converts each bank file in `paths` to a wavetable in `dirname` on worker threads */
+ExportStats exportWavetableLibrary(const std::vector<std::string> &paths, const char *dirname, WavetableGeometry geometry, ExportFormat format, bool raw);
+
 
 ////////////////////
 // history.cpp
@@ -209,30 +678,72 @@ struct Bank {
 
 /** Call as much as you like. History will only be pushed if a time delay between the last call has occurred. */
 void historyPush();
+/** Groups the edits until the matching historyCommit() into one undo step
+historyPush() calls in between are deferred, so the bank is copied once rather than once per wave.
+The step is always a new one, even within the time window in which historyPush() merges edits.
+Transactions nest.
+*/
+void historyBegin();
+void historyCommit();
 void historyUndo();
 void historyRedo();
 void historyClear();
 
 extern Bank currentBank;
+/** Incremented whenever currentBank is replaced by another bank, as by opening or generating one, but not by edits or undo */
+extern int bankGeneration;
 
 
 ////////////////////
-// catalog.cpp
+// autosave.cpp
 ////////////////////
 
-struct CatalogFile {
-	float samples[WAVE_LEN];
-	std::string name;
-};
+/** Starts the thread which writes currentBank to `filename` in the background */
+void autosaveInit(const char *filename);
+/** Snapshots currentBank once it has changed and edits have settled. Call once per frame. */
+void autosaveUpdate();
+/** Writes any unsaved changes and stops the thread */
+void autosaveDestroy();
+
+
+////////////////////
+// jobs.cpp
+////////////////////
 
-struct CatalogCategory {
-	std::vector<CatalogFile> files;
+/** Work which runs on the thread pool, so the UI keeps drawing frames
+A handle to a Job acts as its future: the UI polls `finished` and `progress`, and sets `cancelled` to abandon it.
+*/
+struct Job {
+	/** Shown in the status line */
 	std::string name;
+	/** Runs on a pool thread. Long jobs should set `progress` and return early if `cancelled` is set. */
+	std::function<void(Job *job)> run;
+	/** Runs on the UI thread from jobsUpdate() after `run` returns, unless the job was cancelled
+	This is where results are moved into the bank, all at once between frames.
+	*/
+	std::function<void()> apply;
+	/** From 0 to 1 */
+	std::atomic<float> progress;
+	std::atomic<bool> cancelled;
+	std::atomic<bool> finished;
+	/** Set by the UI thread on jobs whose `apply` replaces the current bank, so an edit which replaces it first can cancel them */
+	bool replacesBank;
+
+	Job() : progress(0.0), cancelled(false), finished(false), replacesBank(false) {}
 };
 
-extern std::vector<CatalogCategory> catalogCategories;
-
-void catalogInit();
+void jobsInit();
+/** Cancels the queued jobs and waits for the running ones */
+void jobsDestroy();
+/** Queues a job on the thread pool. Jobs may run concurrently. Those marked `replacesBank` are applied in submission order, and the rest as soon as they finish. */
+std::shared_ptr<Job> jobsSubmit(const char *name, std::function<void(Job *job)> run, std::function<void()> apply);
+/** Applies the results of finished jobs. Call once per frame, outside of uiRender(). */
+void jobsUpdate();
+void jobsCancelAll();
+/** Cancels the jobs marked `replacesBank`. Call before replacing the current bank on the UI thread, so a job submitted earlier does not land on top of it. */
+void jobsCancelBankJobs();
+/** Jobs which have not been applied yet, in submission order */
+const std::vector<std::shared_ptr<Job>> &jobsPending();
 
 
 ////////////////////
@@ -246,6 +757,8 @@ extern float playFrequencySmooth;
 extern bool playEnabled;
 extern bool playModeXY;
 extern bool morphInterpolate;
+/** Morph through the harmonic spectrum rather than crossfading samples */
+extern bool morphSpectral;
 extern float morphX;
 extern float morphY;
 extern float morphZ;
@@ -260,6 +773,8 @@ void audioClose();
 void audioOpen(int deviceId);
 void audioInit();
 void audioDestroy();
+/** Copies `playingBank` into the audio thread's snapshot. Call once per frame. */
+void audioUpdate();
 
 
 ////////////////////
@@ -278,6 +793,13 @@ enum Tool {
 };
 
 
+/** Oversampling of the post-effect curves drawn by the widgets */
+#define DISPLAY_OVERSAMPLE 4
+
+/** Returns the band-limited post samples of a wave, WAVE_LEN * DISPLAY_OVERSAMPLE long
+Cached per wave index, and recomputed only when the wave's version changes.
+*/
+const float *getDisplayCurve(Bank *bank, int waveId);
 bool renderWave(const char *name, float height, float *points, int pointsLen, const float *lines, int linesLen, enum Tool tool = NO_TOOL);
 bool renderHistogram(const char *name, float height, float *bars, int barsLen, const float *ghost, int ghostLen, enum Tool tool);
 void renderBankGrid(const char *name, float height, int gridWidth, float *gridX, float *gridY);
@@ -286,6 +808,12 @@ void renderWaterfall(const char *name, float height, float amplitude, float angl
 Returns the relative amount dragged
 */
 float renderBankWave(const char *name, float height, const float *lines, int linesLen, float bankStart, float bankEnd, int bankLen);
+/** An image of the bank's harmonic magnitudes, with waves across and harmonics upward
+`matrix` is BANK_LEN rows of WAVE_LEN / 2 magnitudes. Painting sets `changed` for each wave it touches, and clicking sets `selected` to the wave under the mouse.
+Keyframe waves are marked at the top.
+Returns whether anything was painted.
+*/
+bool renderHarmonicMatrix(const char *name, float height, float *matrix, bool *changed, const bool *keyframes, int *selected, float brushValue, float brushSize, enum Tool tool);
 
 ////////////////////
 // ui.cpp
@@ -307,3 +835,10 @@ extern char lastFilename[1024];
 ////////////////////
 
 void importPage();
+
+
+////////////////////
+// generator.cpp
+////////////////////
+
+void generatorPage();
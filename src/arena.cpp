@@ -0,0 +1,109 @@
+#include "WaveEdit.hpp"
+
+
+/** Size of a thread's first block. Enough for every per-frame temporary of the UI thread. */
+static const size_t firstBlockSize = 1<<20;
+
+struct ArenaBlock {
+	uint8_t *data;
+	size_t size;
+};
+
+/** Blocks owned by one thread, filled in order */
+struct Arena {
+	std::vector<ArenaBlock> blocks;
+	/** Position of the next allocation */
+	int block = 0;
+	size_t offset = 0;
+
+	~Arena() {
+		for (const ArenaBlock &b : blocks) {
+			alignedFree(b.data);
+		}
+	}
+};
+
+static thread_local Arena arena;
+
+// Counted across all threads since the last arenaFrameEnd()
+static std::atomic<int> allocations(0);
+static std::atomic<int64_t> bytes(0);
+static std::atomic<int> heapAllocations(0);
+
+ArenaStats arenaFrameStats = {};
+
+
+void *arenaAlloc(size_t size, size_t align) {
+	// alignedMalloc() aligns blocks to 64 bytes
+	assert(align <= 64 && (align & (align - 1)) == 0);
+	Arena &a = arena;
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	bytes.fetch_add(size, std::memory_order_relaxed);
+
+	while (true) {
+		if (a.block < (int) a.blocks.size()) {
+			ArenaBlock &b = a.blocks[a.block];
+			size_t start = (a.offset + align - 1) & ~(align - 1);
+			if (start + size <= b.size) {
+				a.offset = start + size;
+				return b.data + start;
+			}
+			// Move on to the next block, leaving the rest of this one unused until the arena is reset
+			a.block++;
+			a.offset = 0;
+			continue;
+		}
+
+		// Each new block is at least double the last, so a thread settles on a few blocks
+		size_t blockSize = a.blocks.empty() ? firstBlockSize : a.blocks.back().size * 2;
+		while (blockSize < size)
+			blockSize *= 2;
+		ArenaBlock b;
+		b.data = (uint8_t*) alignedMalloc(blockSize);
+		b.size = blockSize;
+		a.blocks.push_back(b);
+		heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+
+void arenaReset() {
+	Arena &a = arena;
+	a.block = 0;
+	a.offset = 0;
+	if (a.blocks.size() <= 1)
+		return;
+
+	// Merge the blocks into one, so the next frame fits without spilling
+	size_t total = 0;
+	for (const ArenaBlock &b : a.blocks) {
+		total += b.size;
+		alignedFree(b.data);
+	}
+	a.blocks.clear();
+	ArenaBlock b;
+	b.data = (uint8_t*) alignedMalloc(total);
+	b.size = total;
+	a.blocks.push_back(b);
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void arenaFrameEnd() {
+	arenaReset();
+	arenaFrameStats.allocations = allocations.exchange(0);
+	arenaFrameStats.bytes = bytes.exchange(0);
+	arenaFrameStats.heapAllocations = heapAllocations.exchange(0);
+}
+
+
+ArenaScope::ArenaScope() {
+	block = arena.block;
+	offset = arena.offset;
+}
+
+
+ArenaScope::~ArenaScope() {
+	arena.block = block;
+	arena.offset = offset;
+}
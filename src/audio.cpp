@@ -9,6 +9,7 @@ float playFrequencySmooth = playFrequency;
 bool playModeXY = false;
 bool playEnabled = false;
 bool morphInterpolate = true;
+bool morphSpectral = false;
 float morphX = 0.0;
 float morphY = 0.0;
 float morphZ = 0.0;
@@ -22,55 +23,71 @@ static float morphZSmooth = morphZ;
 static SDL_AudioDeviceID audioDevice = 0;
 static SDL_AudioSpec audioSpec;
 static SRC_STATE *audioSrc = NULL;
+/** The converter runs inside the audio callback, so playback uses the cheapest sinc tier */
+static const ResampleQuality audioQuality = RESAMPLE_SINC_FASTEST;
+/** Loaded by audioUpdate() while the audio thread reads the other one, then swapped in under the audio lock */
+static BankPlanes planesBuffers[2];
+/** Only read by the audio thread */
+static BankPlanes *playingPlanes = &planesBuffers[0];
 
 long srcCallback(void *cb_data, float **data) {
 	float gain = powf(10.0, playVolume / 20.0);
 	// Generate next samples
 	const int inLen = 33;
 	static float in[inLen];
-	for (int i = 0; i < inLen; i++) {
-		if (morphInterpolate) {
-			const float lambdaMorph = fminf(0.1 / playFrequency, 0.5);
-			morphXSmooth = crossf(morphXSmooth, clampf(morphX, 0.0, BANK_GRID_WIDTH - 1), lambdaMorph);
-			morphYSmooth = crossf(morphYSmooth, clampf(morphY, 0.0, BANK_GRID_HEIGHT - 1), lambdaMorph);
-			morphZSmooth = crossf(morphZSmooth, clampf(morphZ, 0.0, BANK_LEN - 1), lambdaMorph);
-		}
-		else {
-			// Snap X, Y, Z
-			morphXSmooth = roundf(morphX);
-			morphYSmooth = roundf(morphY);
-			morphZSmooth = roundf(morphZ);
+
+	// Advance the morph position once per block, using the smoothing constant accumulated over `inLen` samples
+	// The frame is then crossfaded from the last block's across the block, so the position does not step every `inLen` samples.
+	if (morphInterpolate) {
+		const float lambdaMorph = fminf(0.1 / playFrequency, 0.5);
+		const float lambdaBlock = 1.0 - powf(1.0 - lambdaMorph, inLen);
+		morphXSmooth = crossf(morphXSmooth, clampf(morphX, 0.0, BANK_GRID_WIDTH - 1), lambdaBlock);
+		morphYSmooth = crossf(morphYSmooth, clampf(morphY, 0.0, BANK_GRID_HEIGHT - 1), lambdaBlock);
+		morphZSmooth = crossf(morphZSmooth, clampf(morphZ, 0.0, BANK_LEN - 1), lambdaBlock);
+	}
+	else {
+		// Snap X, Y, Z
+		morphXSmooth = roundf(morphX);
+		morphYSmooth = roundf(morphY);
+		morphZSmooth = roundf(morphZ);
+	}
+
+	float frame[WAVE_LEN];
+	if (morphSpectral) {
+		// Read from the precomputed lattice
+		bool ready = playModeXY ? latticeMorphXY(morphXSmooth, morphYSmooth, frame) : latticeMorphZ(morphZSmooth, frame);
+		if (!ready) {
+			// While the lattice is rebuilding, resynthesize directly
+			// This costs an IRFFT, so reuse the last frame until the morph position or the bank changes
+			static float cachedFrame[WAVE_LEN];
+			static float cachedPosition[3] = {-1.0, -1.0, -1.0};
+			static int cachedRevision = -1;
+			float position[3] = {playModeXY ? morphXSmooth : -1.f, playModeXY ? morphYSmooth : -1.f, playModeXY ? -1.f : morphZSmooth};
+			if (cachedRevision != playingPlanes->revision || memcmp(cachedPosition, position, sizeof(position)) != 0) {
+				if (playModeXY)
+					playingPlanes->morphSpectralXY(morphXSmooth, morphYSmooth, cachedFrame);
+				else
+					playingPlanes->morphSpectralZ(morphZSmooth, cachedFrame);
+				memcpy(cachedPosition, position, sizeof(position));
+				cachedRevision = playingPlanes->revision;
+			}
+			memcpy(frame, cachedFrame, sizeof(frame));
 		}
+	}
+	else if (playModeXY) {
+		playingPlanes->morphXY(morphXSmooth, morphYSmooth, frame);
+	}
+	else {
+		playingPlanes->morphZ(morphZSmooth, frame);
+	}
 
+	static float lastFrame[WAVE_LEN];
+	for (int i = 0; i < inLen; i++) {
 		int index = (playIndex + i) % WAVE_LEN;
-		if (playModeXY) {
-			// Morph XY
-			int xi = morphXSmooth;
-			float xf = morphXSmooth - xi;
-			int yi = morphYSmooth;
-			float yf = morphYSmooth - yi;
-			// 2D linear interpolate
-			float v0 = crossf(
-				playingBank->waves[yi * BANK_GRID_WIDTH + xi].postSamples[index],
-				playingBank->waves[yi * BANK_GRID_WIDTH + eucmodi(xi + 1, BANK_GRID_WIDTH)].postSamples[index],
-				xf);
-			float v1 = crossf(
-				playingBank->waves[eucmodi(yi + 1, BANK_GRID_HEIGHT) * BANK_GRID_WIDTH + xi].postSamples[index],
-				playingBank->waves[eucmodi(yi + 1, BANK_GRID_HEIGHT) * BANK_GRID_WIDTH + eucmodi(xi + 1, BANK_GRID_WIDTH)].postSamples[index],
-				xf);
-			in[i] = crossf(v0, v1, yf);
-		}
-		else {
-			// Morph Z
-			int zi = morphZSmooth;
-			float zf = morphZSmooth - zi;
-			in[i] = crossf(
-				playingBank->waves[zi].postSamples[index],
-				playingBank->waves[eucmodi(zi + 1, BANK_LEN)].postSamples[index],
-				zf);
-		}
-		in[i] = clampf(in[i] * gain, -1.0, 1.0);
+		float x = morphInterpolate ? crossf(lastFrame[index], frame[index], (float) (i + 1) / inLen) : frame[index];
+		in[i] = clampf(x * gain, -1.0, 1.0);
 	}
+	memcpy(lastFrame, frame, sizeof(frame));
 
 	playIndex += inLen;
 	playIndex %= WAVE_LEN;
@@ -147,8 +164,9 @@ void audioOpen(int deviceId) {
 
 void audioInit() {
 	assert(!audioSrc);
+	latticeInit();
 	int err;
-	audioSrc = src_callback_new(srcCallback, SRC_SINC_FASTEST, 1, &err, NULL);
+	audioSrc = src_callback_new(srcCallback, srcConverterType(audioQuality), 1, &err, NULL);
 	assert(audioSrc);
 	audioOpen(-1);
 }
@@ -156,4 +174,24 @@ void audioInit() {
 void audioDestroy() {
 	audioClose();
 	src_delete(audioSrc);
+	latticeDestroy();
+}
+
+void audioUpdate() {
+	if (!playingBank)
+		return;
+	// Copying the waves and taking their phases is slow enough to glitch the audio, so it happens outside the lock
+	BankPlanes *planes = (playingPlanes == &planesBuffers[0]) ? &planesBuffers[1] : &planesBuffers[0];
+	int revision = planes->revision;
+	planes->load(playingBank);
+	if (planes->revision != revision) {
+		// Each buffer counts its own revisions, so keep them increasing across swaps for the audio thread's frame cache
+		planes->revision = playingPlanes->revision + 1;
+		SDL_LockAudioDevice(audioDevice);
+		playingPlanes = planes;
+		SDL_UnlockAudioDevice(audioDevice);
+	}
+	// The lattice catches up on the waves which changed in the meantime when spectral morphing is turned on
+	if (morphSpectral)
+		latticeUpdate(playingBank);
 }
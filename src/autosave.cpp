@@ -0,0 +1,130 @@
+#include "WaveEdit.hpp"
+#include <SDL.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(ARCH_WIN)
+	#include <windows.h>
+#endif
+
+
+/** Seconds without edits before a snapshot is taken, so dragging does not write on every frame */
+static const double settleTime = 1.0;
+
+static std::string autosaveFilename;
+/** Versions of the bank last handed to the writer */
+static uint32_t savedVersions[BANK_LEN];
+/** Set by the wave listener, which can run on any thread */
+static std::atomic<uint32_t> lastEditTicks(0);
+
+// The following are guarded by `mutex`
+static std::mutex mutex;
+static std::condition_variable cv;
+/** Snapshot waiting to be written, or NULL */
+static Bank *pending = NULL;
+static bool running = false;
+static std::thread thread;
+
+
+static void onWaveChange(Wave *wave) {
+	if (currentBank.waves <= wave && wave < currentBank.waves + BANK_LEN) {
+		lastEditTicks = SDL_GetTicks();
+	}
+}
+
+
+/** Writes to a temporary file and renames it, so a crash mid-write never leaves a truncated autosave */
+static void writeBank(Bank *bank) {
+	std::string tmpFilename = autosaveFilename + ".tmp";
+	// A failed write, such as on a full disk, keeps the previous autosave
+	if (!bank->save(tmpFilename.c_str())) {
+		remove(tmpFilename.c_str());
+		return;
+	}
+#if defined(ARCH_WIN)
+	// rename() does not replace existing files on Windows, and removing the old file first would leave no autosave if the rename failed
+	MoveFileExA(tmpFilename.c_str(), autosaveFilename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	rename(tmpFilename.c_str(), autosaveFilename.c_str());
+#endif
+}
+
+
+static void autosaveRun() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		if (!pending) {
+			if (!running)
+				break;
+			cv.wait(lock);
+			continue;
+		}
+		Bank *bank = pending;
+		pending = NULL;
+		lock.unlock();
+		writeBank(bank);
+		delete bank;
+		lock.lock();
+	}
+}
+
+
+static void recordVersions() {
+	for (int j = 0; j < BANK_LEN; j++) {
+		savedVersions[j] = currentBank.waves[j].version;
+	}
+}
+
+
+static bool isDirty() {
+	for (int j = 0; j < BANK_LEN; j++) {
+		if (savedVersions[j] != currentBank.waves[j].version)
+			return true;
+	}
+	return false;
+}
+
+
+/** Hands a copy of currentBank to the writer, replacing any snapshot it has not started on */
+static void snapshot() {
+	Bank *bank = new Bank(currentBank);
+	recordVersions();
+	std::lock_guard<std::mutex> lock(mutex);
+	delete pending;
+	pending = bank;
+	cv.notify_one();
+}
+
+
+void autosaveInit(const char *filename) {
+	autosaveFilename = filename;
+	// The bank was just loaded from this file
+	recordVersions();
+	waveSubscribe(onWaveChange);
+	running = true;
+	thread = std::thread(autosaveRun);
+}
+
+
+void autosaveUpdate() {
+	// Versions also catch undo and redo, which replace waves without editing them
+	if (!isDirty())
+		return;
+	if (SDL_GetTicks() - lastEditTicks < settleTime * 1000)
+		return;
+	snapshot();
+}
+
+
+void autosaveDestroy() {
+	if (isDirty())
+		snapshot();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		cv.notify_one();
+	}
+	// The writer finishes the pending snapshot before exiting
+	thread.join();
+}
@@ -1,15 +1,21 @@
 #include "WaveEdit.hpp"
+#include <stddef.h>
 #include <string.h>
-#include <sndfile.h>
+
+#if defined(_WIN32)
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
 
 
 void Bank::clear() {
 	// The lazy way
 	memset(this, 0, sizeof(Bank));
 
-	for (int i = 0; i < BANK_LEN; i++) {
+	parallelFor(0, BANK_LEN, [&](int i) {
 		waves[i].commitSamples();
-	}
+	});
 }
 
 
@@ -17,6 +23,8 @@ void Bank::swap(int i, int j) {
 	Wave tmp = waves[i];
 	waves[i] = waves[j];
 	waves[j] = tmp;
+	waves[i].bump();
+	waves[j].bump();
 }
 
 
@@ -29,10 +37,10 @@ void Bank::shuffle() {
 
 
 void Bank::setSamples(const float *in) {
-	for (int j = 0; j < BANK_LEN; j++) {
+	parallelFor(0, BANK_LEN, [&](int j) {
 		memcpy(waves[j].samples, &in[j * WAVE_LEN], sizeof(float) * WAVE_LEN);
 		waves[j].commitSamples();
-	}
+	});
 }
 
 
@@ -43,21 +51,80 @@ void Bank::getPostSamples(float *out) {
 }
 
 
+void Bank::getHarmonics(float *out) {
+	for (int j = 0; j < BANK_LEN; j++) {
+		memcpy(&out[j * WAVE_LEN / 2], waves[j].harmonics, sizeof(float) * WAVE_LEN / 2);
+	}
+}
+
+
+void Bank::setHarmonics(const float *in, const bool *changed) {
+	// Gather the changed waves first, so the pool only splits real work
+	int ids[BANK_LEN];
+	int idsLen = 0;
+	for (int j = 0; j < BANK_LEN; j++) {
+		if (changed[j])
+			ids[idsLen++] = j;
+	}
+	parallelFor(0, idsLen, [&](int k) {
+		Wave *wave = &waves[ids[k]];
+		memcpy(wave->harmonics, &in[ids[k] * WAVE_LEN / 2], sizeof(float) * WAVE_LEN / 2);
+		wave->commitHarmonics();
+	});
+}
+
+
+void Bank::getEffect(EffectID effect, float *out) {
+	for (int j = 0; j < BANK_LEN; j++) {
+		out[j] = waves[j].effects[effect];
+	}
+}
+
+
 void Bank::duplicateToAll(int waveId) {
 	for (int j = 0; j < BANK_LEN; j++) {
-		if (j != waveId)
+		if (j != waveId) {
 			waves[j] = waves[waveId];
-		// No need to commit the wave because we're copying everything
+			// No need to commit the wave because we're copying everything
+			waves[j].bump();
+		}
 	}
 }
 
 
-void Bank::save(const char *filename) {
+bool Bank::sameVersions(const Bank *other) const {
+	for (int j = 0; j < BANK_LEN; j++) {
+		if (waves[j].version != other->waves[j].version)
+			return false;
+	}
+	return true;
+}
+
+
+/** Flushes the stream and then the OS's cache of the file to the disk */
+static bool syncFile(FILE *f) {
+	if (fflush(f) != 0)
+		return false;
+#if defined(_WIN32)
+	return _commit(_fileno(f)) == 0;
+#else
+	return fsync(fileno(f)) == 0;
+#endif
+}
+
+
+bool Bank::save(const char *filename) {
 	FILE *f = fopen(filename, "wb");
 	if (!f)
-		return;
-	fwrite(this, sizeof(*this), 1, f);
-	fclose(f);
+		return false;
+	// Records end before the version, which keeps the format of files saved before versions existed
+	bool ok = true;
+	for (int j = 0; j < BANK_LEN && ok; j++) {
+		ok = fwrite(&waves[j], offsetof(Wave, version), 1, f) == 1;
+	}
+	ok = ok && syncFile(f);
+	ok = (fclose(f) == 0) && ok;
+	return ok;
 }
 
 
@@ -67,54 +134,186 @@ void Bank::load(const char *filename) {
 	FILE *f = fopen(filename, "rb");
 	if (!f)
 		return;
-	fread(this, sizeof(*this), 1, f);
+	for (int j = 0; j < BANK_LEN; j++) {
+		fread(&waves[j], offsetof(Wave, version), 1, f);
+	}
 	fclose(f);
 
-	for (int j = 0; j < BANK_LEN; j++) {
+	parallelFor(0, BANK_LEN, [&](int j) {
 		waves[j].commitSamples();
-	}
+	});
 }
 
 
 void Bank::saveWAV(const char *filename) {
-	SF_INFO info;
-	info.samplerate = 44100;
-	info.channels = 1;
-	info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16 | SF_ENDIAN_LITTLE;
-	SNDFILE *sf = sf_open(filename, SFM_WRITE, &info);
-	if (!sf)
-		return;
-
-	for (int j = 0; j < BANK_LEN; j++) {
-		sf_write_float(sf, waves[j].postSamples, WAVE_LEN);
-	}
-
-	sf_close(sf);
+	// Encoded with the same conversions as the exporters, so all PCM16 files round and dither alike
+	float *samples = new float[BANK_LEN * WAVE_LEN];
+	getPostSamples(samples);
+	std::vector<uint8_t> data;
+	encodeWAV(samples, BANK_LEN * WAVE_LEN, 44100, EXPORT_PCM16, data);
+	delete[] samples;
+	writeFile(filename, data);
 }
 
 
 void Bank::loadWAV(const char *filename) {
 	clear();
 
-	SF_INFO info;
-	SNDFILE *sf = sf_open(filename, SFM_READ, &info);
-	if (!sf)
+	int len;
+	float *samples = loadAudio(filename, &len);
+	if (!samples)
 		return;
 
+	// Missing waves are left cleared
 	for (int i = 0; i < BANK_LEN; i++) {
-		sf_read_float(sf, waves[i].samples, WAVE_LEN);
+		int waveLen = clampi(len - i * WAVE_LEN, 0, WAVE_LEN);
+		memcpy(waves[i].samples, &samples[i * WAVE_LEN], sizeof(float) * waveLen);
 		waves[i].commitSamples();
 	}
 
-	sf_close(sf);
+	delete[] samples;
 }
 
 
 void Bank::saveWaves(const char *dirname) {
-	for (int b = 0; b < BANK_LEN; b++) {
-		char filename[1024];
-		snprintf(filename, sizeof(filename), "%s/%02d.wav", dirname, b);
+	exportWaves(this, dirname, EXPORT_PCM16);
+}
+
+
+void BankPlanes::load(Bank *bank) {
+	bool changed = false;
+	for (int j = 0; j < BANK_LEN; j++) {
+		Wave *wave = &bank->waves[j];
+		if (versions[j] == wave->version)
+			continue;
+		changed = true;
+		versions[j] = wave->version;
+		memcpy(postSamples[j], wave->postSamples, sizeof(float) * WAVE_LEN);
+		memcpy(postSpectrum[j], wave->postSpectrum, sizeof(float) * WAVE_LEN);
+		memcpy(postHarmonics[j], wave->postHarmonics, sizeof(float) * WAVE_LEN / 2);
+		for (int k = 0; k < WAVE_LEN / 2; k++) {
+			postPhases[j][k] = atan2f(postSpectrum[j][2 * k + 1], postSpectrum[j][2 * k]);
+		}
+	}
+	if (changed)
+		revision++;
+	for (int i = 0; i < EFFECTS_LEN; i++) {
+		bank->getEffect((EffectID) i, effects[i]);
+	}
+}
+
+
+void BankPlanes::morphZ(float z, float *out) {
+	int zi = z;
+	float zf = z - zi;
+	const float *a = postSamples[zi];
+	const float *b = postSamples[eucmodi(zi + 1, BANK_LEN)];
+	for (int i = 0; i < WAVE_LEN; i++) {
+		out[i] = a[i] + (b[i] - a[i]) * zf;
+	}
+}
+
+
+void BankPlanes::morphXY(float x, float y, float *out) {
+	int xi = x;
+	float xf = x - xi;
+	int yi = y;
+	float yf = y - yi;
+	int x1 = eucmodi(xi + 1, BANK_GRID_WIDTH);
+	int y1 = eucmodi(yi + 1, BANK_GRID_HEIGHT);
+	const float *a = postSamples[yi * BANK_GRID_WIDTH + xi];
+	const float *b = postSamples[yi * BANK_GRID_WIDTH + x1];
+	const float *c = postSamples[y1 * BANK_GRID_WIDTH + xi];
+	const float *d = postSamples[y1 * BANK_GRID_WIDTH + x1];
+	for (int i = 0; i < WAVE_LEN; i++) {
+		float v0 = a[i] + (b[i] - a[i]) * xf;
+		float v1 = c[i] + (d[i] - c[i]) * xf;
+		out[i] = v0 + (v1 - v0) * yf;
+	}
+}
+
+
+/** Mixes the spectra of `waves` with `weights` and resynthesizes a cycle
+Phases are measured relative to the first wave and wrapped, so each partial takes the shortest path.
+*/
+static void spectralMix(const BankPlanes *planes, const int *waves, const float *weights, int len, float *out) {
+	float spectrum[WAVE_LEN];
+	int a = waves[0];
+	// DC and Nyquist are real
+	spectrum[0] = 0.0;
+	spectrum[1] = 0.0;
+	for (int n = 0; n < len; n++) {
+		spectrum[0] += weights[n] * planes->postSpectrum[waves[n]][0];
+		spectrum[1] += weights[n] * planes->postSpectrum[waves[n]][1];
+	}
+	for (int k = 1; k < WAVE_LEN / 2; k++) {
+		float magnitude = 0.0;
+		float phase = planes->postPhases[a][k];
+		for (int n = 0; n < len; n++) {
+			int j = waves[n];
+			magnitude += weights[n] * planes->postHarmonics[j][k];
+			phase += weights[n] * wrapPhasef(planes->postPhases[j][k] - planes->postPhases[a][k]);
+		}
+		// Harmonics are twice the bin magnitude
+		magnitude /= 2.0;
+		spectrum[2 * k] = magnitude * cosf(phase);
+		spectrum[2 * k + 1] = magnitude * sinf(phase);
+	}
+	IRFFT<WAVE_LEN>(spectrum, out);
+}
+
+
+void BankPlanes::morphSpectralZ(float z, float *out) {
+	int zi = z;
+	float zf = z - zi;
+	int waves[2] = {zi, eucmodi(zi + 1, BANK_LEN)};
+	float weights[2] = {1.f - zf, zf};
+	spectralMix(this, waves, weights, 2, out);
+}
+
+
+void BankPlanes::morphSpectralXY(float x, float y, float *out) {
+	int xi = x;
+	float xf = x - xi;
+	int yi = y;
+	float yf = y - yi;
+	int x1 = eucmodi(xi + 1, BANK_GRID_WIDTH);
+	int y1 = eucmodi(yi + 1, BANK_GRID_HEIGHT);
+	int waves[4] = {
+		yi * BANK_GRID_WIDTH + xi,
+		yi * BANK_GRID_WIDTH + x1,
+		y1 * BANK_GRID_WIDTH + xi,
+		y1 * BANK_GRID_WIDTH + x1,
+	};
+	float weights[4] = {
+		(1.f - xf) * (1.f - yf),
+		xf * (1.f - yf),
+		(1.f - xf) * yf,
+		xf * yf,
+	};
+	spectralMix(this, waves, weights, 4, out);
+}
+
 
-		waves[b].saveWAV(filename);
+void interpolateKeyframes(float *matrix, const bool *keyframes, bool *changed) {
+	const int rows = WAVE_LEN / 2;
+	int prev = -1;
+	for (int j = 0; j <= BANK_LEN; j++) {
+		if (j < BANK_LEN && !keyframes[j])
+			continue;
+		// No keyframes
+		if (prev < 0 && j == BANK_LEN)
+			return;
+		// Fill the gap between the previous keyframe and this one
+		int from = (prev >= 0) ? prev : j;
+		int to = (j < BANK_LEN) ? j : prev;
+		for (int k = prev + 1; k < j; k++) {
+			float frac = (to > from) ? (float) (k - from) / (to - from) : 0.0;
+			for (int i = 0; i < rows; i++) {
+				matrix[k * rows + i] = crossf(matrix[from * rows + i], matrix[to * rows + i], frac);
+			}
+			changed[k] = true;
+		}
+		prev = j;
 	}
 }
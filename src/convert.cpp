@@ -0,0 +1,176 @@
+#include "WaveEdit.hpp"
+
+
+// Sample format conversion
+// Like kernels.cpp, the loops are written without branches and compiled once per instruction set, so the compiler vectorizes each variant.
+// On ARM the generic variant is vectorized with NEON.
+
+#define FORCE_INLINE inline __attribute__((always_inline))
+
+// Integer formats are read with a scale of 2^-(bits - 1) like libsndfile, so both WAV readers agree.
+// They are written with a scale of 2^(bits - 1) - 1, so +1.0 does not wrap.
+
+/** float to int conversion which rounds halves away from zero, like roundf(), for |x| < 2^31
+Truncates and then steps away from zero on a fraction of a half or more, since adding 0.5 before truncating rounds 0.49999997 up to 1.
+*/
+static FORCE_INLINE int32_t roundToInt(float x) {
+	int32_t t = (int32_t) x;
+	float r = x - (float) t;
+	return t + (r >= 0.5f) - (r <= -0.5f);
+}
+
+static FORCE_INLINE float clampUnit(float x) {
+	return fminf(fmaxf(x, -1.f), 1.f);
+}
+
+/** Integer hash by Chris Wellons, used as a counter-based random generator so the dither loop has no serial dependency */
+static FORCE_INLINE uint32_t hash32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+
+// Kernel bodies
+
+static FORCE_INLINE void i16ToF32Body(const int16_t *in, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = in[i] * (1.f / 0x8000);
+	}
+}
+
+static FORCE_INLINE void i24ToF32Body(const uint8_t *in, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		// Shift into the top of an int32 so the sign is extended, in unsigned arithmetic since shifting into the sign bit of an int is undefined
+		int32_t x = (int32_t) (((uint32_t) in[3 * i] << 8) | ((uint32_t) in[3 * i + 1] << 16) | ((uint32_t) in[3 * i + 2] << 24));
+		out[i] = x * (1.f / 0x80000000u);
+	}
+}
+
+static FORCE_INLINE void i32ToF32Body(const int32_t *in, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = in[i] * (1.f / 0x80000000u);
+	}
+}
+
+static FORCE_INLINE void f32ToI16Body(const float *in, int16_t *out, int len, const float *dither) {
+	for (int i = 0; i < len; i++) {
+		float x = clampUnit(in[i]) * 0x7fff;
+		if (dither)
+			x = fminf(fmaxf(x + dither[i], -0x8000), 0x7fff);
+		out[i] = roundToInt(x);
+	}
+}
+
+static FORCE_INLINE void f32ToI24Body(const float *in, uint8_t *out, int len, const float *dither) {
+	for (int i = 0; i < len; i++) {
+		float x = clampUnit(in[i]) * 0x7fffff;
+		if (dither)
+			x = fminf(fmaxf(x + dither[i], -0x800000), 0x7fffff);
+		int32_t y = roundToInt(x);
+		out[3 * i] = y;
+		out[3 * i + 1] = y >> 8;
+		out[3 * i + 2] = y >> 16;
+	}
+}
+
+static FORCE_INLINE void tpdfDitherBody(float *noise, int len, uint32_t seed) {
+	for (int i = 0; i < len; i++) {
+		uint32_t counter = seed + 2 * (uint32_t) i;
+		float a = (hash32(counter) >> 8) * (1.f / (1 << 24));
+		float b = (hash32(counter + 1) >> 8) * (1.f / (1 << 24));
+		// The sum of two uniform variables on [0, 1) has a triangular distribution on [0, 2)
+		noise[i] = a + b - 1.f;
+	}
+}
+
+static FORCE_INLINE void f32ToI32Body(const float *in, int32_t *out, int len) {
+	for (int i = 0; i < len; i++) {
+		// 2^31 - 1 is not representable as a float, so scale in double, where adding a half before truncating is exact
+		double x = clampUnit(in[i]) * 2147483647.0;
+		out[i] = (int32_t) (x + copysign(0.5, x));
+	}
+}
+
+
+// Instruction set variants
+
+#define DEFINE_CONVERT_KERNELS(isa, attr) \
+	attr static void i16_to_f32_##isa(const int16_t *in, float *out, int len) { i16ToF32Body(in, out, len); } \
+	attr static void i24_to_f32_##isa(const uint8_t *in, float *out, int len) { i24ToF32Body(in, out, len); } \
+	attr static void i32_to_f32_##isa(const int32_t *in, float *out, int len) { i32ToF32Body(in, out, len); } \
+	attr static void f32_to_i16_##isa(const float *in, int16_t *out, int len, const float *dither) { f32ToI16Body(in, out, len, dither); } \
+	attr static void f32_to_i24_##isa(const float *in, uint8_t *out, int len, const float *dither) { f32ToI24Body(in, out, len, dither); } \
+	attr static void f32_to_i32_##isa(const float *in, int32_t *out, int len) { f32ToI32Body(in, out, len); } \
+	attr static void tpdfDither_##isa(float *noise, int len, uint32_t seed) { tpdfDitherBody(noise, len, seed); } \
+	static const ConvertKernels convertKernels_##isa = { \
+		#isa, \
+		i16_to_f32_##isa, \
+		i24_to_f32_##isa, \
+		i32_to_f32_##isa, \
+		f32_to_i16_##isa, \
+		f32_to_i24_##isa, \
+		f32_to_i32_##isa, \
+		tpdfDither_##isa, \
+	};
+
+DEFINE_CONVERT_KERNELS(generic, )
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define CONVERT_X86
+	// SSE4.1 adds the sign-extending loads and float rounding used by the integer conversions
+	DEFINE_CONVERT_KERNELS(sse41, __attribute__((target("sse4.1"))))
+	DEFINE_CONVERT_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+#endif
+
+
+static const ConvertKernels *selectConvertKernels() {
+#ifdef CONVERT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return &convertKernels_avx2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return &convertKernels_sse41;
+#endif
+	return &convertKernels_generic;
+}
+
+const ConvertKernels *convertKernels() {
+	static const ConvertKernels *kernels = selectConvertKernels();
+	return kernels;
+}
+
+
+void i16_to_f32(const int16_t *in, float *out, int length) {
+	convertKernels()->i16_to_f32(in, out, length);
+}
+
+void i24_to_f32(const uint8_t *in, float *out, int length) {
+	convertKernels()->i24_to_f32(in, out, length);
+}
+
+void i32_to_f32(const int32_t *in, float *out, int length) {
+	convertKernels()->i32_to_f32(in, out, length);
+}
+
+void f32_to_i16(const float *in, int16_t *out, int length, const float *dither) {
+	// The rounding in here has an incredible amount of controversy among DSP enthusiasts.
+	convertKernels()->f32_to_i16(in, out, length, dither);
+}
+
+void f32_to_i24(const float *in, uint8_t *out, int length, const float *dither) {
+	convertKernels()->f32_to_i24(in, out, length, dither);
+}
+
+void f32_to_i32(const float *in, int32_t *out, int length) {
+	convertKernels()->f32_to_i32(in, out, length);
+}
+
+
+void tpdfDither(float *noise, int length, uint32_t *seed) {
+	convertKernels()->tpdfDither(noise, length, *seed);
+	*seed += 2 * (uint32_t) length;
+}
@@ -0,0 +1,381 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+
+const char *exportFormatNames[EXPORT_FORMATS_LEN] = {
+	"16-bit PCM",
+	"24-bit PCM",
+	"32-bit Float",
+};
+
+ExportFormat exportFormat = EXPORT_PCM16;
+bool exportDither = false;
+
+
+static double getTime() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Little-endian writers
+
+static void put16(std::vector<uint8_t> &out, uint16_t x) {
+	out.push_back(x);
+	out.push_back(x >> 8);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t x) {
+	out.push_back(x);
+	out.push_back(x >> 8);
+	out.push_back(x >> 16);
+	out.push_back(x >> 24);
+}
+
+static void putTag(std::vector<uint8_t> &out, const char *tag) {
+	out.insert(out.end(), tag, tag + 4);
+}
+
+
+static void putFmt(std::vector<uint8_t> &out, int sampleRate, ExportFormat format) {
+	int bytesPerSample = exportFormatBytes(format);
+	putTag(out, "fmt ");
+	put32(out, 16);
+	// WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT
+	put16(out, (format == EXPORT_FLOAT) ? 3 : 1);
+	// Mono
+	put16(out, 1);
+	put32(out, sampleRate);
+	put32(out, sampleRate * bytesPerSample);
+	put16(out, bytesPerSample);
+	put16(out, bytesPerSample * 8);
+}
+
+static void putSamples(std::vector<uint8_t> &out, const float *samples, int len, ExportFormat format, uint32_t *ditherSeed) {
+	size_t pos = out.size();
+	out.resize(pos + (size_t) len * exportFormatBytes(format));
+	// Converted in place, which assumes a little-endian host
+	uint8_t *data = out.data() + pos;
+	switch (format) {
+		case EXPORT_PCM16: {
+			float *noise = NULL;
+			if (exportDither) {
+				noise = new float[len];
+				tpdfDither(noise, len, ditherSeed);
+			}
+			// Chunk headers are word aligned
+			f32_to_i16(samples, (int16_t*) data, len, noise);
+			delete[] noise;
+		} break;
+		case EXPORT_PCM24: f32_to_i24(samples, data, len); break;
+		case EXPORT_FLOAT: {
+			for (int i = 0; i < len; i++) {
+				float x = clampf(samples[i], -1.0, 1.0);
+				memcpy(data + 4 * i, &x, 4);
+			}
+		} break;
+		default: break;
+	}
+}
+
+
+int exportFormatBytes(ExportFormat format) {
+	switch (format) {
+		case EXPORT_PCM16: return 2;
+		case EXPORT_PCM24: return 3;
+		default: return 4;
+	}
+}
+
+
+void encodeWAV(const float *samples, int len, int sampleRate, ExportFormat format, std::vector<uint8_t> &out) {
+	uint32_t dataSize = len * exportFormatBytes(format);
+	out.clear();
+	out.reserve(44 + dataSize);
+
+	putTag(out, "RIFF");
+	put32(out, 36 + dataSize);
+	putTag(out, "WAVE");
+	putFmt(out, sampleRate, format);
+	putTag(out, "data");
+	put32(out, dataSize);
+	uint32_t ditherSeed = 1;
+	putSamples(out, samples, len, format, &ditherSeed);
+}
+
+
+bool writeFile(const char *filename, const std::vector<uint8_t> &data) {
+	FILE *f = fopen(filename, "wb");
+	if (!f)
+		return false;
+	size_t written = fwrite(data.data(), 1, data.size(), f);
+	fclose(f);
+	return written == data.size();
+}
+
+
+/** Appends a ustar header and the padded file contents
+Returns false without appending if `name` is longer than the 100 byte name field. Entries are base names, so the prefix field, which holds leading directories, cannot extend it.
+*/
+static bool tarAppend(std::vector<uint8_t> &tar, const char *name, const std::vector<uint8_t> &data) {
+	size_t nameLen = strlen(name);
+	if (nameLen > 100)
+		return false;
+	uint8_t header[512] = {};
+	// A name of exactly 100 bytes fills the field without a terminator
+	memcpy(header + 0, name, nameLen);
+	snprintf((char*) header + 100, 8, "%07o", 0644);
+	snprintf((char*) header + 108, 8, "%07o", 0);
+	snprintf((char*) header + 116, 8, "%07o", 0);
+	snprintf((char*) header + 124, 12, "%011o", (unsigned) data.size());
+	snprintf((char*) header + 136, 12, "%011o", 0);
+	header[156] = '0';
+	memcpy(header + 257, "ustar", 6);
+	memcpy(header + 263, "00", 2);
+	// The checksum is computed with its own field filled with spaces
+	memset(header + 148, ' ', 8);
+	unsigned checksum = 0;
+	for (int i = 0; i < 512; i++) {
+		checksum += header[i];
+	}
+	snprintf((char*) header + 148, 8, "%06o", checksum);
+
+	tar.insert(tar.end(), header, header + 512);
+	tar.insert(tar.end(), data.begin(), data.end());
+	tar.resize((tar.size() + 511) / 512 * 512, 0);
+	return true;
+}
+
+
+bool WavetableWriter::open(const char *filename, int cycleLen, ExportFormat format, bool raw) {
+	f = fopen(filename, "wb");
+	if (!f)
+		return false;
+	// Raw tables are always headerless 32-bit float
+	this->format = raw ? EXPORT_FLOAT : format;
+	this->raw = raw;
+	dataSize = 0;
+	headerSize = 0;
+	ditherSeed = 1;
+	if (raw)
+		return true;
+
+	// Sizes are patched in close()
+	std::vector<uint8_t> header;
+	putTag(header, "RIFF");
+	put32(header, 0);
+	putTag(header, "WAVE");
+	putFmt(header, 44100, format);
+
+	// Serum's cycle length marker, also read by Vital
+	char clm[64];
+	int clmLen = snprintf(clm, sizeof(clm), "<!>%d 00000000 wavetable (WaveEdit)", cycleLen);
+	putTag(header, "clm ");
+	put32(header, clmLen);
+	header.insert(header.end(), clm, clm + clmLen);
+	// Chunks are word aligned
+	if (clmLen % 2)
+		header.push_back(0);
+
+	putTag(header, "data");
+	put32(header, 0);
+
+	headerSize = header.size();
+	return fwrite(header.data(), 1, headerSize, f) == headerSize;
+}
+
+
+void WavetableWriter::write(const float *samples, int len) {
+	if (!f)
+		return;
+	buffer.clear();
+	putSamples(buffer, samples, len, format, &ditherSeed);
+	dataSize += fwrite(buffer.data(), 1, buffer.size(), f);
+}
+
+
+bool WavetableWriter::close() {
+	if (!f)
+		return false;
+	bool ok = !ferror(f);
+	if (!raw) {
+		// Odd-sized data chunks are padded
+		if (dataSize % 2)
+			fputc(0, f);
+		std::vector<uint8_t> size;
+		put32(size, headerSize - 8 + dataSize + dataSize % 2);
+		fseek(f, 4, SEEK_SET);
+		fwrite(size.data(), 1, 4, f);
+		size.clear();
+		put32(size, dataSize);
+		fseek(f, headerSize - 4, SEEK_SET);
+		fwrite(size.data(), 1, 4, f);
+	}
+	ok = (fclose(f) == 0) && ok;
+	f = NULL;
+	return ok;
+}
+
+
+int64_t exportWavetable(Bank *bank, const char *filename, WavetableGeometry geometry, ExportFormat format, bool raw) {
+	WavetableWriter writer;
+	if (!writer.open(filename, geometry.waveLen, format, raw))
+		return 0;
+
+	// Only one frame is held in memory at a time
+	BankPlanes *planes = new BankPlanes();
+	planes->load(bank);
+	float *frame = new float[geometry.waveLen];
+	for (int j = 0; j < geometry.bankLen; j++) {
+		renderWavetableFrame(planes, j, geometry.bankLen, frame, geometry.waveLen);
+		writer.write(frame, geometry.waveLen);
+	}
+	delete[] frame;
+	delete planes;
+
+	int64_t bytes = writer.headerSize + writer.dataSize;
+	return writer.close() ? bytes : 0;
+}
+
+
+ExportStats exportWavetableLibrary(const std::vector<std::string> &paths, const char *dirname, WavetableGeometry geometry, ExportFormat format, bool raw) {
+	double startTime = getTime();
+	std::atomic<int> files(0);
+	std::atomic<int64_t> bytes(0);
+
+	parallelFor(0, paths.size(), [&](int i) {
+		// Replace the extension
+		const char *name = strrchr(paths[i].c_str(), '/');
+		name = name ? name + 1 : paths[i].c_str();
+		std::string filename = std::string(dirname) + "/" + name;
+		filename = filename.substr(0, filename.rfind('.')) + (raw ? ".raw" : ".wav");
+		// Exporting into the folder being read would overwrite the banks
+		if (filename == paths[i])
+			return;
+
+		Bank *bank = new Bank();
+		bank->loadWAV(paths[i].c_str());
+		int64_t written = exportWavetable(bank, filename.c_str(), geometry, format, raw);
+		delete bank;
+		if (written > 0) {
+			files++;
+			bytes += written;
+		}
+	});
+
+	ExportStats stats;
+	stats.files = files;
+	stats.bytes = bytes;
+	stats.seconds = getTime() - startTime;
+	return stats;
+}
+
+
+ExportStats exportWaves(Bank *bank, const char *dirname, ExportFormat format) {
+	double startTime = getTime();
+	std::atomic<int> files(0);
+	std::atomic<int64_t> bytes(0);
+
+	parallelFor(0, BANK_LEN, [&](int j) {
+		std::vector<uint8_t> data;
+		encodeWAV(bank->waves[j].postSamples, WAVE_LEN, 44100, format, data);
+
+		char filename[1024];
+		snprintf(filename, sizeof(filename), "%s/%02d.wav", dirname, j);
+		if (writeFile(filename, data)) {
+			files++;
+			bytes += data.size();
+		}
+	});
+
+	ExportStats stats;
+	stats.files = files;
+	stats.bytes = bytes;
+	stats.seconds = getTime() - startTime;
+	return stats;
+}
+
+
+std::vector<std::string> listBankFiles(const char *dirname) {
+	std::vector<std::string> paths;
+	DIR *dir = opendir(dirname);
+	if (!dir)
+		return paths;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		const char *ext = strrchr(entry->d_name, '.');
+		if (ext && (strcmp(ext, ".wav") == 0 || strcmp(ext, ".WAV") == 0)) {
+			paths.push_back(std::string(dirname) + "/" + entry->d_name);
+		}
+	}
+	closedir(dir);
+
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+
+
+ExportStats exportLibrary(const std::vector<std::string> &paths, const char *outPath, ExportFormat format, bool archive) {
+	double startTime = getTime();
+	int pathsLen = paths.size();
+	std::atomic<int> files(0);
+	std::atomic<int64_t> bytes(0);
+	// Archive entries are kept in order and written by this thread at the end
+	std::vector<std::vector<uint8_t>> encoded(archive ? pathsLen : 0);
+
+	parallelFor(0, pathsLen, [&](int i) {
+		const char *name = strrchr(paths[i].c_str(), '/');
+		name = name ? name + 1 : paths[i].c_str();
+		std::string filename = std::string(outPath) + "/" + name;
+		// Exporting into the folder being read would overwrite the banks
+		if (!archive && filename == paths[i])
+			return;
+
+		Bank *bank = new Bank();
+		bank->loadWAV(paths[i].c_str());
+		float samples[BANK_LEN * WAVE_LEN];
+		bank->getPostSamples(samples);
+		delete bank;
+
+		std::vector<uint8_t> data;
+		encodeWAV(samples, BANK_LEN * WAVE_LEN, 44100, format, data);
+
+		if (archive) {
+			encoded[i] = std::move(data);
+			return;
+		}
+		if (writeFile(filename.c_str(), data)) {
+			files++;
+			bytes += data.size();
+		}
+	});
+
+	if (archive) {
+		std::vector<uint8_t> tar;
+		int appended = 0;
+		for (int i = 0; i < pathsLen; i++) {
+			const char *name = strrchr(paths[i].c_str(), '/');
+			name = name ? name + 1 : paths[i].c_str();
+			// Banks with names too long for the header are left out, and missing from the file count
+			if (tarAppend(tar, name, encoded[i]))
+				appended++;
+		}
+		// End-of-archive marker
+		tar.resize(tar.size() + 1024, 0);
+		if (writeFile(outPath, tar)) {
+			files = appended;
+			bytes = tar.size();
+		}
+	}
+
+	ExportStats stats;
+	stats.files = files;
+	stats.bytes = bytes;
+	stats.seconds = getTime() - startTime;
+	return stats;
+}
@@ -0,0 +1,386 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <ctype.h>
+
+
+// Expressions compile to stack bytecode where each instruction loops over a whole wave, so the interpreter's dispatch is paid once per 128 samples and the loops vectorize.
+
+static inline float fractf(float x) {
+	return x - floorf(x);
+}
+
+static inline float signf(float x) {
+	return (x > 0.f) - (x < 0.f);
+}
+
+/** Replaces infinities and NaNs with 0, by the bit pattern since -ffast-math assumes they never occur */
+static inline float zeroNonFinite(float x) {
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return ((bits & 0x7f800000) == 0x7f800000) ? 0.f : x;
+}
+
+
+#define EXPR_UNARY(f) { \
+	float *a = stack[*top - 1]; \
+	for (int i = 0; i < len; i++) { \
+		float x = a[i]; \
+		a[i] = (f); \
+	} \
+} break;
+
+#define EXPR_BINARY(f) { \
+	float *a = stack[*top - 2]; \
+	const float *b = stack[*top - 1]; \
+	for (int i = 0; i < len; i++) { \
+		float x = a[i]; \
+		float y = b[i]; \
+		a[i] = (f); \
+	} \
+	(*top)--; \
+} break;
+
+#define EXPR_LEAF(f) { \
+	float *a = stack[*top]; \
+	for (int i = 0; i < len; i++) { \
+		a[i] = (f); \
+	} \
+	(*top)++; \
+} break;
+
+/** Runs one instruction on `len` samples of wave `waveId`, with the stack's top at `stack[*top - 1]` */
+static void execute(const ExprOp &op, float **stack, int *top, int len, int waveId, const float *params) {
+	switch (op.code) {
+		case EXPR_CONST: EXPR_LEAF(op.value)
+		case EXPR_X: EXPR_LEAF((float) i / len)
+		case EXPR_Z: EXPR_LEAF((float) waveId / (BANK_LEN - 1))
+		case EXPR_W: EXPR_LEAF((float) waveId)
+		case EXPR_PARAM: EXPR_LEAF(params[(int) op.value])
+
+		case EXPR_NEG: EXPR_UNARY(-x)
+		case EXPR_SIN: EXPR_UNARY(sinf(x))
+		case EXPR_COS: EXPR_UNARY(cosf(x))
+		case EXPR_TAN: EXPR_UNARY(tanf(x))
+		case EXPR_TANH: EXPR_UNARY(tanhf(x))
+		case EXPR_EXP: EXPR_UNARY(expf(x))
+		case EXPR_LOG: EXPR_UNARY(logf(x))
+		case EXPR_SQRT: EXPR_UNARY(sqrtf(x))
+		case EXPR_ABS: EXPR_UNARY(fabsf(x))
+		case EXPR_FLOOR: EXPR_UNARY(floorf(x))
+		case EXPR_CEIL: EXPR_UNARY(ceilf(x))
+		case EXPR_ROUND: EXPR_UNARY(roundf(x))
+		case EXPR_FRACT: EXPR_UNARY(fractf(x))
+		case EXPR_SIGN: EXPR_UNARY(signf(x))
+		// Naive oscillators with a period of 1, in phase with sin(2*pi*x)
+		case EXPR_SAW: EXPR_UNARY(2.f * fractf(x + 0.5f) - 1.f)
+		case EXPR_SQR: EXPR_UNARY(fractf(x) < 0.5f ? 1.f : -1.f)
+		case EXPR_TRI: EXPR_UNARY(4.f * fabsf(fractf(x - 0.25f) - 0.5f) - 1.f)
+
+		case EXPR_ADD: EXPR_BINARY(x + y)
+		case EXPR_SUB: EXPR_BINARY(x - y)
+		case EXPR_MUL: EXPR_BINARY(x * y)
+		case EXPR_DIV: EXPR_BINARY(x / y)
+		// Floored like GLSL's mod(), so the result takes the sign of the divisor
+		case EXPR_MOD: EXPR_BINARY(x - y * floorf(x / y))
+		case EXPR_POW: EXPR_BINARY(powf(x, y))
+		case EXPR_MIN: EXPR_BINARY(fminf(x, y))
+		case EXPR_MAX: EXPR_BINARY(fmaxf(x, y))
+		case EXPR_ATAN2: EXPR_BINARY(atan2f(x, y))
+		case EXPR_LESS: EXPR_BINARY(x < y ? 1.f : 0.f)
+		case EXPR_GREATER: EXPR_BINARY(x > y ? 1.f : 0.f)
+
+		case EXPR_CLAMP: {
+			float *a = stack[*top - 3];
+			const float *lo = stack[*top - 2];
+			const float *hi = stack[*top - 1];
+			for (int i = 0; i < len; i++) {
+				a[i] = fminf(fmaxf(a[i], lo[i]), hi[i]);
+			}
+			(*top) -= 2;
+		} break;
+	}
+}
+
+
+struct ExprFunction {
+	const char *name;
+	ExprOpcode code;
+	int arity;
+};
+
+static const ExprFunction functions[] = {
+	{"sin", EXPR_SIN, 1},
+	{"cos", EXPR_COS, 1},
+	{"tan", EXPR_TAN, 1},
+	{"tanh", EXPR_TANH, 1},
+	{"exp", EXPR_EXP, 1},
+	{"log", EXPR_LOG, 1},
+	{"sqrt", EXPR_SQRT, 1},
+	{"abs", EXPR_ABS, 1},
+	{"floor", EXPR_FLOOR, 1},
+	{"ceil", EXPR_CEIL, 1},
+	{"round", EXPR_ROUND, 1},
+	{"fract", EXPR_FRACT, 1},
+	{"sign", EXPR_SIGN, 1},
+	{"saw", EXPR_SAW, 1},
+	{"sqr", EXPR_SQR, 1},
+	{"tri", EXPR_TRI, 1},
+	{"mod", EXPR_MOD, 2},
+	{"pow", EXPR_POW, 2},
+	{"min", EXPR_MIN, 2},
+	{"max", EXPR_MAX, 2},
+	{"atan2", EXPR_ATAN2, 2},
+	{"clamp", EXPR_CLAMP, 3},
+};
+
+
+/** Recursive descent parser which emits bytecode in postfix order
+After the first error, the parse functions return without emitting anything.
+*/
+struct ExprParser {
+	const char *text;
+	int pos = 0;
+	std::vector<ExprOp> ops;
+	int depth = 0;
+	int maxDepth = 0;
+	std::string error;
+
+	void fail(const char *message) {
+		if (error.empty())
+			error = stringf("%s at column %d", message, pos + 1);
+	}
+
+	void skipSpace() {
+		while (text[pos] == ' ' || text[pos] == '\t')
+			pos++;
+	}
+
+	bool accept(char c) {
+		skipSpace();
+		if (text[pos] != c)
+			return false;
+		pos++;
+		return true;
+	}
+
+	void expect(char c) {
+		if (!accept(c))
+			fail(stringf("Expected '%c'", c).c_str());
+	}
+
+	void leaf(ExprOpcode code, float value = 0.f) {
+		ExprOp op;
+		op.code = code;
+		op.value = value;
+		ops.push_back(op);
+		depth++;
+		maxDepth = maxi(maxDepth, depth);
+	}
+
+	/** Emits an operator on the top `arity` values, folding it if they are all constants */
+	void apply(ExprOpcode code, int arity) {
+		if (!error.empty())
+			return;
+		depth -= arity - 1;
+		int n = ops.size();
+		bool constant = true;
+		for (int k = n - arity; k < n; k++) {
+			constant = constant && ops[k].code == EXPR_CONST;
+		}
+		ExprOp op;
+		op.code = code;
+		op.value = 0.f;
+		if (constant) {
+			// Run the instruction on a one-sample stack
+			float values[3];
+			float *stack[3] = {&values[0], &values[1], &values[2]};
+			for (int k = 0; k < arity; k++) {
+				values[k] = ops[n - arity + k].value;
+			}
+			int top = arity;
+			execute(op, stack, &top, 1, 0, NULL);
+			ops.resize(n - arity);
+			op.code = EXPR_CONST;
+			op.value = values[0];
+		}
+		ops.push_back(op);
+	}
+
+	void parseComparison() {
+		parseSum();
+		while (error.empty()) {
+			if (accept('<')) {
+				parseSum();
+				apply(EXPR_LESS, 2);
+			}
+			else if (accept('>')) {
+				parseSum();
+				apply(EXPR_GREATER, 2);
+			}
+			else break;
+		}
+	}
+
+	void parseSum() {
+		parseProduct();
+		while (error.empty()) {
+			if (accept('+')) {
+				parseProduct();
+				apply(EXPR_ADD, 2);
+			}
+			else if (accept('-')) {
+				parseProduct();
+				apply(EXPR_SUB, 2);
+			}
+			else break;
+		}
+	}
+
+	void parseProduct() {
+		parseUnary();
+		while (error.empty()) {
+			if (accept('*')) {
+				parseUnary();
+				apply(EXPR_MUL, 2);
+			}
+			else if (accept('/')) {
+				parseUnary();
+				apply(EXPR_DIV, 2);
+			}
+			else if (accept('%')) {
+				parseUnary();
+				apply(EXPR_MOD, 2);
+			}
+			else break;
+		}
+	}
+
+	void parseUnary() {
+		if (accept('-')) {
+			parseUnary();
+			apply(EXPR_NEG, 1);
+		}
+		else if (accept('+')) {
+			parseUnary();
+		}
+		else {
+			parsePower();
+		}
+	}
+
+	void parsePower() {
+		parsePrimary();
+		// Right associative, and binds tighter than a unary minus on its left, so -x^2 is -(x^2)
+		if (error.empty() && accept('^')) {
+			parseUnary();
+			apply(EXPR_POW, 2);
+		}
+	}
+
+	void parsePrimary() {
+		if (!error.empty())
+			return;
+		skipSpace();
+		char c = text[pos];
+
+		if (accept('(')) {
+			parseComparison();
+			expect(')');
+			return;
+		}
+
+		if (('0' <= c && c <= '9') || c == '.') {
+			char *end;
+			float value = strtof(text + pos, &end);
+			if (end == text + pos) {
+				fail("Invalid number");
+				return;
+			}
+			pos = end - text;
+			leaf(EXPR_CONST, value);
+			return;
+		}
+
+		// ctype functions are undefined for negative chars other than EOF, which bytes of UTF-8 text are where char is signed
+		if (isalpha((unsigned char) c) || c == '_') {
+			int start = pos;
+			while (isalnum((unsigned char) text[pos]) || text[pos] == '_')
+				pos++;
+			std::string name(text + start, pos - start);
+
+			// Variables and constants
+			if (name == "x") leaf(EXPR_X);
+			else if (name == "z") leaf(EXPR_Z);
+			else if (name == "w") leaf(EXPR_W);
+			else if (name == "pi") leaf(EXPR_CONST, M_PI);
+			else if (name == "e") leaf(EXPR_CONST, M_E);
+			else if (name.size() == 1 && 'a' <= name[0] && name[0] < 'a' + EXPR_PARAMS_LEN) leaf(EXPR_PARAM, name[0] - 'a');
+			else {
+				// Functions
+				for (const ExprFunction &f : functions) {
+					if (name != f.name)
+						continue;
+					expect('(');
+					for (int k = 0; k < f.arity; k++) {
+						if (k > 0)
+							expect(',');
+						parseComparison();
+					}
+					expect(')');
+					apply(f.code, f.arity);
+					return;
+				}
+				pos = start;
+				fail(stringf("Unknown name '%s'", name.c_str()).c_str());
+			}
+			return;
+		}
+
+		if (c == '\0')
+			fail("Unexpected end");
+		else
+			fail(stringf("Unexpected '%c'", c).c_str());
+	}
+};
+
+
+bool Expr::compile(const char *text, std::string *error) {
+	ExprParser parser;
+	parser.text = text;
+	parser.parseComparison();
+	parser.skipSpace();
+	if (parser.error.empty() && text[parser.pos] != '\0')
+		parser.fail(stringf("Unexpected '%c'", text[parser.pos]).c_str());
+
+	if (!parser.error.empty()) {
+		if (error)
+			*error = parser.error;
+		return false;
+	}
+	ops = parser.ops;
+	stackLen = parser.maxDepth;
+	return true;
+}
+
+
+void Expr::evaluate(float *out) const {
+	if (ops.empty()) {
+		memset(out, 0, sizeof(float) * BANK_LEN * WAVE_LEN);
+		return;
+	}
+	parallelFor(0, BANK_LEN, [&](int j) {
+		ArenaScope scope;
+		float **stack = arenaArray<float*>(stackLen);
+		for (int k = 0; k < stackLen; k++) {
+			stack[k] = arenaArray<float>(WAVE_LEN);
+		}
+		int top = 0;
+		for (const ExprOp &op : ops) {
+			execute(op, stack, &top, WAVE_LEN, j, params);
+		}
+		float *wave = &out[j * WAVE_LEN];
+		for (int i = 0; i < WAVE_LEN; i++) {
+			wave[i] = zeroNonFinite(stack[0][i]);
+		}
+	});
+}
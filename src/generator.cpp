@@ -0,0 +1,103 @@
+#include "WaveEdit.hpp"
+
+#include "imgui.h"
+
+
+static const char *examples[] = {
+	"sin(2*pi*x*(1+z*7))*exp(-z*x)",
+	"tanh(sin(2*pi*x)*(1+z*20))",
+	"(1-z)*saw(x) + z*sqr(x)",
+	"sin(2*pi*x + a*10*z*sin(2*pi*x*(1+b*4)))",
+	"tri(x*(1+floor(z*8)))",
+	"sin(2*pi*x)*(1-z) + sin(2*pi*x*(2+w))*z/2",
+};
+
+static char text[1024] = "sin(2*pi*x*(1+z*7))*exp(-z*x)";
+static Expr expr;
+static std::string error;
+/** The expression or its parameters changed since the bank was last generated */
+static bool dirty = true;
+static Bank generatorBank;
+
+
+static void setText(const char *newText) {
+	snprintf(text, sizeof(text), "%s", newText);
+	dirty = true;
+}
+
+
+/** Recompiles and regenerates the preview bank */
+static void generate() {
+	if (expr.compile(text, &error))
+		error = "";
+	// A failed compile keeps the previous program, so the preview stays up while typing
+	float *samples = arenaArray<float>(BANK_LEN * WAVE_LEN);
+	expr.evaluate(samples);
+	generatorBank.setSamples(samples);
+}
+
+
+void generatorPage() {
+	ImGui::BeginChild("Generator", ImVec2(0, 0), true);
+	{
+		ImGui::PushItemWidth(-1.0);
+
+		// Expression
+		ImGui::Text("Expression");
+		if (ImGui::InputText("##expression", text, sizeof(text)))
+			dirty = true;
+		if (!error.empty())
+			ImGui::Text("%s", error.c_str());
+		else
+			ImGui::Text("x: phase 0 to 1, z: bank position 0 to 1, w: wave index, a to d: parameters, pi, e");
+
+		static int example = 0;
+		if (ImGui::Combo("##examples", &example, examples, sizeof(examples) / sizeof(examples[0])))
+			setText(examples[example]);
+
+		// Parameters
+		for (int k = 0; k < EXPR_PARAMS_LEN; k++) {
+			char id[32];
+			snprintf(id, sizeof(id), "##param%d", k);
+			char format[32];
+			snprintf(format, sizeof(format), "%c: %%.3f", 'a' + k);
+			if (ImGui::SliderFloat(id, &expr.params[k], 0.0, 1.0, format))
+				dirty = true;
+		}
+
+		if (dirty) {
+			generate();
+			dirty = false;
+		}
+
+		// Preview
+		playingBank = &generatorBank;
+		ImGui::Text("Bank Preview");
+		float *bankSamples = arenaArray<float>(BANK_LEN * WAVE_LEN);
+		generatorBank.getPostSamples(bankSamples);
+		renderBankWave("generator preview", 200.0, bankSamples,
+			BANK_LEN * WAVE_LEN,
+			0,
+			BANK_LEN * WAVE_LEN,
+			BANK_LEN);
+
+		// Apply
+		if (ImGui::Button("Reset")) {
+			setText(examples[0]);
+			for (int k = 0; k < EXPR_PARAMS_LEN; k++) {
+				expr.params[k] = 0.0;
+			}
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Generate")) {
+			// A bank still being opened or baked would otherwise replace the generated one when it finishes
+			jobsCancelBankJobs();
+			currentBank = generatorBank;
+			bankGeneration++;
+			historyPush();
+		}
+
+		ImGui::PopItemWidth();
+	}
+	ImGui::EndChild();
+}
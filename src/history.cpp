@@ -3,14 +3,24 @@
 
 
 Bank currentBank;
+int bankGeneration = 0;
 
 static std::vector<Bank> history;
 static int currentIndex = -1;
 static double previousTime = -INFINITY;
 static const double delayTime = 0.2;
+static int transactionDepth = 0;
 
 
 void historyPush() {
+	// Deferred to historyCommit()
+	if (transactionDepth > 0)
+		return;
+
+	// Nothing was edited since the last push
+	if (currentIndex >= 0 && currentBank.sameVersions(&history[currentIndex]))
+		return;
+
 	double time = SDL_GetTicks() / 1000.0;
 	if (time - previousTime >= delayTime) {
 		currentIndex++;
@@ -23,6 +33,21 @@ void historyPush() {
 	previousTime = time;
 }
 
+void historyBegin() {
+	transactionDepth++;
+}
+
+void historyCommit() {
+	assert(transactionDepth > 0);
+	transactionDepth--;
+	if (transactionDepth > 0)
+		return;
+	// A transaction is an undo step of its own, so it neither merges into the edit before it nor takes in the edit after it
+	previousTime = -INFINITY;
+	historyPush();
+	previousTime = -INFINITY;
+}
+
 void historyUndo() {
 	if (currentIndex >= 1) {
 		currentIndex--;
@@ -42,5 +67,6 @@ void historyRedo() {
 void historyClear() {
 	history.clear();
 	currentIndex = -1;
+	transactionDepth = 0;
 	previousTime = -INFINITY;
 }
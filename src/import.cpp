@@ -16,15 +16,31 @@ enum ImportMode {
 	MULTIPLY_IMPORT,
 };
 
+enum ImportChannel {
+	LEFT_CHANNEL,
+	RIGHT_CHANNEL,
+	MID_CHANNEL,
+	SIDE_CHANNEL,
+	/** Each channel fills an equal range of the bank */
+	SPREAD_CHANNELS,
+};
+
 static float gain;
 static float offset;
 static float zoom;
 static float leftTrim;
 static float rightTrim;
 static ImportMode mode;
+static ImportChannel channel;
+/** Planar channels of the loaded file */
+static float *audioPlanes = NULL;
+static int audioChannels;
+/** The selected channel, or the mid channel when spreading */
 static float *audio = NULL;
 static int audioLen;
 static float *audioPreview = NULL;
+/** Incremented whenever `audio` changes, so a preview rendered for older audio is dropped */
+static int audioRevision = 0;
 static char status[1024] = "";
 static Bank importBank;
 
@@ -43,6 +59,11 @@ static void clearImport() {
 	leftTrim = 0.0;
 	rightTrim = BANK_LEN;
 	mode = CLEAR_IMPORT;
+	channel = MID_CHANNEL;
+	if (audioPlanes)
+		delete[] audioPlanes;
+	audioPlanes = NULL;
+	audioChannels = 0;
 	if (audio)
 		delete[] audio;
 	audio = NULL;
@@ -50,104 +71,257 @@ static void clearImport() {
 	if (audioPreview)
 		delete[] audioPreview;
 	audioPreview = NULL;
+	audioRevision++;
 
 	status[0] = '\0';
 	importBank.clear();
 }
 
-static void loadImport(const char *path) {
-	clearImport();
-	audio = loadAudio(path, &audioLen);
-	if (!audio) {
-		snprintf(status, sizeof(status), "Cannot load audio file. Only WAV files are supported.");
-		return;
+/** Derives one channel of `len` samples from the planes */
+static void deriveChannel(const float *planes, int len, int channels, ImportChannel channel, float *out) {
+	const float *l = planes;
+	const float *r = planes + mini(1, channels - 1) * len;
+	switch (channel) {
+		case LEFT_CHANNEL:
+			memcpy(out, l, sizeof(float) * len);
+			break;
+		case RIGHT_CHANNEL:
+			memcpy(out, r, sizeof(float) * len);
+			break;
+		case SIDE_CHANNEL:
+			for (int i = 0; i < len; i++) {
+				out[i] = (l[i] - r[i]) * 0.5f;
+			}
+			break;
+		case MID_CHANNEL:
+		case SPREAD_CHANNELS: {
+			// Average of all channels
+			memcpy(out, l, sizeof(float) * len);
+			for (int c = 1; c < channels; c++) {
+				const float *plane = planes + c * len;
+				for (int i = 0; i < len; i++) {
+					out[i] += plane[i];
+				}
+			}
+			float scale = 1.0 / channels;
+			for (int i = 0; i < len; i++) {
+				out[i] *= scale;
+			}
+		} break;
 	}
+}
 
-	if (audioLen > audioLenMax) {
-		snprintf(status, sizeof(status), "Audio file contains %d samples, may have up to %d", audioLen, audioLenMax);
-		delete[] audio;
-		audio = NULL;
-		return;
-	}
+/** Renders the audio preview by resampling to constant size */
+static void renderAudioPreview(const float *audio, int len, float *preview) {
+	double previewRatio = BANK_LEN * WAVE_LEN / (double)len;
+	resample(audio, len, preview, BANK_LEN * WAVE_LEN, previewRatio, RESAMPLE_SINC_MEDIUM);
+}
 
-	if (audioLen < audioLenMin) {
-		snprintf(status, sizeof(status), "Audio file contains %d samples, must have at least %d", audioLen, audioLenMin);
-		delete[] audio;
-		audio = NULL;
-		return;
+/** Audio decoded by the loading job, owned by the job until it is handed to the import page */
+struct LoadedAudio {
+	float *planes = NULL;
+	int len = 0;
+	int channels = 0;
+	float *mid = NULL;
+	float *preview = NULL;
+	char status[1024] = "";
+
+	~LoadedAudio() {
+		delete[] planes;
+		delete[] mid;
+		delete[] preview;
 	}
+};
 
-	zoomFit();
+static void selectChannel(ImportChannel newChannel) {
+	channel = newChannel;
+	deriveChannel(audioPlanes, audioLen, audioChannels, channel, audio);
+
+	// The sinc preview of a long file takes a while, so it renders on the pool from a copy of the channel
+	int revision = ++audioRevision;
+	std::shared_ptr<LoadedAudio> rendered = std::make_shared<LoadedAudio>();
+	rendered->len = audioLen;
+	rendered->mid = new float[audioLen];
+	memcpy(rendered->mid, audio, sizeof(float) * audioLen);
+
+	jobsSubmit("Rendering audio preview", [=](Job *job) {
+		rendered->preview = new float[BANK_LEN * WAVE_LEN]();
+		renderAudioPreview(rendered->mid, rendered->len, rendered->preview);
+	}, [=]() {
+		// The audio was cleared, reloaded or switched to another channel in the meantime
+		if (revision != audioRevision)
+			return;
+		delete[] audioPreview;
+		audioPreview = rendered->preview;
+		rendered->preview = NULL;
+	});
+}
 
-	// Generate status line
-	char *pathCpy = strdup(path);
-	char *filename = basename(pathCpy);
-	ellipsize(filename, 80);
-	snprintf(status, sizeof(status), "%s: %d samples", filename, audioLen);
-	free(pathCpy);
+static void loadImport(const char *path) {
+	std::string pathStr = path;
+	std::shared_ptr<LoadedAudio> loaded = std::make_shared<LoadedAudio>();
+
+	jobsSubmit("Loading audio", [=](Job *job) {
+		loaded->planes = loadAudioPlanar(pathStr.c_str(), &loaded->len, &loaded->channels);
+		if (!loaded->planes) {
+			snprintf(loaded->status, sizeof(loaded->status), "Cannot load audio file. Only WAV files are supported.");
+			return;
+		}
 
-	// Render audio preview by resampling to constant size
-	audioPreview = new float[BANK_LEN * WAVE_LEN]();
-	double previewRatio = BANK_LEN * WAVE_LEN / (double)audioLen;
-	resample(audio, audioLen, audioPreview, BANK_LEN * WAVE_LEN, previewRatio);
+		if (loaded->len > audioLenMax || loaded->len < audioLenMin) {
+			if (loaded->len > audioLenMax)
+				snprintf(loaded->status, sizeof(loaded->status), "Audio file contains %d samples, may have up to %d", loaded->len, audioLenMax);
+			else
+				snprintf(loaded->status, sizeof(loaded->status), "Audio file contains %d samples, must have at least %d", loaded->len, audioLenMin);
+			delete[] loaded->planes;
+			loaded->planes = NULL;
+			return;
+		}
+		job->progress = 0.5;
+		if (job->cancelled)
+			return;
+
+		// Generate status line
+		char *pathCpy = strdup(pathStr.c_str());
+		char *filename = basename(pathCpy);
+		ellipsize(filename, 80);
+		snprintf(loaded->status, sizeof(loaded->status), "%s: %d samples, %d channels", filename, loaded->len, loaded->channels);
+		free(pathCpy);
+
+		loaded->mid = new float[loaded->len];
+		deriveChannel(loaded->planes, loaded->len, loaded->channels, MID_CHANNEL, loaded->mid);
+		loaded->preview = new float[BANK_LEN * WAVE_LEN]();
+		renderAudioPreview(loaded->mid, loaded->len, loaded->preview);
+	}, [=]() {
+		clearImport();
+		snprintf(status, sizeof(status), "%s", loaded->status);
+		if (!loaded->planes)
+			return;
+		// Take ownership of the buffers
+		audioPlanes = loaded->planes;
+		audioLen = loaded->len;
+		audioChannels = loaded->channels;
+		audio = loaded->mid;
+		audioPreview = loaded->preview;
+		loaded->planes = NULL;
+		loaded->mid = NULL;
+		loaded->preview = NULL;
+		channel = MID_CHANNEL;
+		zoomFit();
+	});
 }
 
 static float getAudioAmplitude() {
+	// Spread channels are imported as they are, so normalize to the loudest one
+	const float *samples = (channel == SPREAD_CHANNELS) ? audioPlanes : audio;
+	int len = (channel == SPREAD_CHANNELS) ? audioLen * audioChannels : audioLen;
 	float max = 0.0;
-	for (int i = 0; i < audioLen; i++) {
-		float amplitude = fabsf(audio[i]);
+	for (int i = 0; i < len; i++) {
+		float amplitude = fabsf(samples[i]);
 		if (amplitude > max)
 			max = amplitude;
 	}
 	return max;
 }
 
-static void computeImport(float *samples) {
-	if (!audio) {
-		currentBank.getPostSamples(samples);
-		return;
-	}
+/** The audio and settings an import is rendered from
+The page previews from the live settings, while the Import button hands a copy to a job.
+*/
+struct ImportSource {
+	const float *planes;
+	int channels;
+	const float *audio;
+	int len;
+	float gain;
+	float offset;
+	float zoom;
+	float leftTrim;
+	float rightTrim;
+	ImportMode mode;
+	ImportChannel channel;
+};
 
-	float importSamples[BANK_LEN * WAVE_LEN] = {};
+static ImportSource currentSource() {
+	ImportSource src;
+	src.planes = audioPlanes;
+	src.channels = audioChannels;
+	src.audio = audio;
+	src.len = audioLen;
+	src.gain = gain;
+	src.offset = offset;
+	src.zoom = zoom;
+	src.leftTrim = leftTrim;
+	src.rightTrim = rightTrim;
+	src.mode = mode;
+	src.channel = channel;
+	return src;
+}
 
+/** Resamples `channelAudio` into the waves [bankStart, bankEnd) of `importSamples`, positioned by the offset, zoom and trim settings
+Returns the written range of samples in `yli` and `yri`.
+*/
+static void importRange(const ImportSource &src, const float *channelAudio, float *importSamples, int bankStart, int bankEnd, ResampleQuality quality, int *yli, int *yri) {
 	// A bunch of weird constants to align the resampler correctly
 	// Basically x's and w's are indices for the audio array, y's are for the bank array
-	float wl = offset * audioLen;
-	float wr = wl + BANK_LEN * WAVE_LEN * zoom;
-	float xl = clampf(wl, 0, audioLen);
-	float xr = clampf(wr, 0, audioLen);
-	float yl = rescalef(xl, wl, wr, 0, BANK_LEN * WAVE_LEN);
-	float yr = rescalef(xr, wl, wr, 0, BANK_LEN * WAVE_LEN);
-	yl = clampf(yl, 0, BANK_LEN * WAVE_LEN);
-	yr = clampf(yr, 0, BANK_LEN * WAVE_LEN);
-	yl = clampf(yl, leftTrim * WAVE_LEN, rightTrim * WAVE_LEN);
-	yr = clampf(yr, leftTrim * WAVE_LEN, rightTrim * WAVE_LEN);
-	xl = rescalef(yl, 0, BANK_LEN * WAVE_LEN, wl, wr);
-	xr = rescalef(yr, 0, BANK_LEN * WAVE_LEN, wl, wr);
+	float y0 = bankStart * WAVE_LEN;
+	float y1 = bankEnd * WAVE_LEN;
+	float wl = src.offset * src.len;
+	float wr = wl + (y1 - y0) * src.zoom;
+	float xl = clampf(wl, 0, src.len);
+	float xr = clampf(wr, 0, src.len);
+	float yl = rescalef(xl, wl, wr, y0, y1);
+	float yr = rescalef(xr, wl, wr, y0, y1);
+	yl = clampf(yl, y0, y1);
+	yr = clampf(yr, y0, y1);
+	yl = clampf(yl, src.leftTrim * WAVE_LEN, src.rightTrim * WAVE_LEN);
+	yr = clampf(yr, src.leftTrim * WAVE_LEN, src.rightTrim * WAVE_LEN);
+	xl = rescalef(yl, y0, y1, wl, wr);
+	xr = rescalef(yr, y0, y1, wl, wr);
 	int xli = roundf(xl);
 	int xri = roundf(xr);
-	int yli = roundf(yl);
-	int yri = roundf(yr);
-	float ratio = clampf(1.0 / zoom, 1/300.0, 300.0);
+	*yli = roundf(yl);
+	*yri = roundf(yr);
+	float ratio = clampf(1.0 / src.zoom, 1/300.0, 300.0);
 
-	resample(audio + xli, xri - xli, importSamples + yli, yri - yli, ratio);
+	resample(channelAudio + xli, xri - xli, importSamples + *yli, *yri - *yli, ratio, quality);
+}
 
-	// Apply mode mixing and gain
-	switch (mode) {
-		case CLEAR_IMPORT:
-			break;
-		case OVERWRITE_IMPORT:
-		case ADD_IMPORT:
-		case MULTIPLY_IMPORT:
-			currentBank.getPostSamples(samples);
-			break;
+/** Mixes the import into `samples`, which must hold the post samples of the bank being imported into */
+static void computeImport(const ImportSource &src, float *samples, ResampleQuality quality) {
+	if (!src.audio)
+		return;
+
+	float *importSamples = arenaArray<float>(BANK_LEN * WAVE_LEN);
+	memset(importSamples, 0, sizeof(float) * BANK_LEN * WAVE_LEN);
+	// Samples outside [yli, yri] are kept by the partial mode
+	int yli;
+	int yri;
+	if (src.channel == SPREAD_CHANNELS) {
+		// Channels beyond one per wave are dropped
+		int ranges = mini(src.channels, BANK_LEN);
+		int l[BANK_LEN];
+		int r[BANK_LEN];
+		// The ranges are disjoint, so the channels resample in parallel
+		parallelFor(0, ranges, [&](int c) {
+			importRange(src, src.planes + c * src.len, importSamples, c * BANK_LEN / ranges, (c + 1) * BANK_LEN / ranges, quality, &l[c], &r[c]);
+		});
+		yli = BANK_LEN * WAVE_LEN;
+		yri = 0;
+		for (int c = 0; c < ranges; c++) {
+			yli = mini(yli, l[c]);
+			yri = maxi(yri, r[c]);
+		}
+	}
+	else {
+		importRange(src, src.audio, importSamples, 0, BANK_LEN, quality, &yli, &yri);
 	}
 
-	float amp = powf(10.0, gain / 20.0);
+	// Apply mode mixing and gain
+	float amp = powf(10.0, src.gain / 20.0);
 	for (int i = 0; i < BANK_LEN * WAVE_LEN; i++) {
 		importSamples[i] *= amp;
 
-		switch (mode) {
+		switch (src.mode) {
 			case CLEAR_IMPORT:
 				samples[i] = importSamples[i];
 				break;
@@ -165,6 +339,17 @@ static void computeImport(float *samples) {
 	}
 }
 
+/** Commits only the preview waves whose samples changed, so a preview which is not being adjusted keeps its wave versions, and the audio thread and morph lattice do not reload it every frame */
+static void setImportSamples(const float *samples) {
+	parallelFor(0, BANK_LEN, [&](int j) {
+		Wave *wave = &importBank.waves[j];
+		if (memcmp(wave->samples, &samples[j * WAVE_LEN], sizeof(float) * WAVE_LEN) == 0)
+			return;
+		memcpy(wave->samples, &samples[j * WAVE_LEN], sizeof(float) * WAVE_LEN);
+		wave->commitSamples();
+	});
+}
+
 
 void importPage() {
 	ImGui::BeginChild("Import", ImVec2(0, 0), true);
@@ -187,7 +372,7 @@ void importPage() {
 		// Audio preview
 		ImGui::Text("Imported Audio Preview");
 		if (audioPreview) {
-			float audioPreviewGain[BANK_LEN * WAVE_LEN] = {};
+			float *audioPreviewGain = arenaArray<float>(BANK_LEN * WAVE_LEN);
 			for (int i = 0; i < BANK_LEN * WAVE_LEN; i++) {
 				audioPreviewGain[i] = amp * audioPreview[i];
 			}
@@ -212,9 +397,12 @@ void importPage() {
 		// Bank preview
 		ImGui::Text("Bank Preview");
 		// Initialize from previous bank
-		float bankSamples[BANK_LEN * WAVE_LEN];
-		computeImport(bankSamples);
-		importBank.setSamples(bankSamples);
+		float *bankSamples = arenaArray<float>(BANK_LEN * WAVE_LEN);
+		// Use a cheap interpolator while a slider or the preview is being dragged
+		ResampleQuality quality = ImGui::IsAnyItemActive() ? RESAMPLE_CUBIC : RESAMPLE_SINC_FASTEST;
+		currentBank.getPostSamples(bankSamples);
+		computeImport(currentSource(), bankSamples, quality);
+		setImportSamples(bankSamples);
 		float deltaBank = renderBankWave("bank preview", 200.0, bankSamples,
 			BANK_LEN * WAVE_LEN,
 			0,
@@ -282,13 +470,49 @@ void importPage() {
 			ImGui::SameLine();
 			if (ImGui::RadioButton("Ring Modulate", mode == MULTIPLY_IMPORT)) mode = MULTIPLY_IMPORT;
 
+			// Channels
+			if (audioChannels > 1) {
+				ImportChannel newChannel = channel;
+				if (ImGui::RadioButton("Left", channel == LEFT_CHANNEL)) newChannel = LEFT_CHANNEL;
+				ImGui::SameLine();
+				if (ImGui::RadioButton("Right", channel == RIGHT_CHANNEL)) newChannel = RIGHT_CHANNEL;
+				ImGui::SameLine();
+				if (ImGui::RadioButton("Mid", channel == MID_CHANNEL)) newChannel = MID_CHANNEL;
+				ImGui::SameLine();
+				if (ImGui::RadioButton("Side", channel == SIDE_CHANNEL)) newChannel = SIDE_CHANNEL;
+				ImGui::SameLine();
+				if (ImGui::RadioButton("Each Channel to a Bank Range", channel == SPREAD_CHANNELS)) newChannel = SPREAD_CHANNELS;
+				if (newChannel != channel)
+					selectChannel(newChannel);
+			}
+
 			// Apply
 			if (ImGui::Button("Cancel")) {
 				clearImport();
 			}
 			ImGui::SameLine();
 			if (ImGui::Button("Import")) {
-				currentBank = importBank;
+				// The best quality takes a while on long files, so the final bank renders on the pool
+				// The job takes over the audio, since the page is cleared right away
+				std::shared_ptr<LoadedAudio> source = std::make_shared<LoadedAudio>();
+				source->planes = audioPlanes;
+				source->mid = audio;
+				ImportSource src = currentSource();
+				audioPlanes = NULL;
+				audio = NULL;
+				std::shared_ptr<Bank> bank = std::make_shared<Bank>();
+				std::vector<float> samples(BANK_LEN * WAVE_LEN);
+				currentBank.getPostSamples(samples.data());
+				jobsCancelBankJobs();
+				jobsSubmit("Importing", [source, src, samples, bank](Job *job) mutable {
+					computeImport(src, samples.data(), RESAMPLE_SINC_BEST);
+					job->progress = 0.5;
+					bank->setSamples(samples.data());
+				}, [=]() {
+					currentBank = *bank;
+					bankGeneration++;
+					historyPush();
+				})->replacesBank = true;
 				clearImport();
 			}
 		}
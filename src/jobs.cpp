@@ -0,0 +1,81 @@
+#include "WaveEdit.hpp"
+
+
+/** Jobs run on the shared pool */
+static TaskGroup *group = NULL;
+
+/** Jobs which have not been applied yet, in submission order. Only touched by the UI thread. */
+static std::vector<std::shared_ptr<Job>> pending;
+
+
+void jobsInit() {
+	group = new TaskGroup();
+}
+
+
+void jobsDestroy() {
+	jobsCancelAll();
+	// Running jobs finish, and the cancelled rest return immediately
+	group->wait();
+	delete group;
+	group = NULL;
+	pending.clear();
+}
+
+
+std::shared_ptr<Job> jobsSubmit(const char *name, std::function<void(Job *job)> run, std::function<void()> apply) {
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->name = name;
+	job->run = run;
+	job->apply = apply;
+	pending.push_back(job);
+
+	group->run([job]() {
+		if (!job->cancelled)
+			job->run(job.get());
+		job->progress = 1.0;
+		job->finished = true;
+	});
+	return job;
+}
+
+
+void jobsUpdate() {
+	// Jobs which replace the bank are applied in submission order, so a later bank never lands before an earlier one
+	// Other jobs are applied as soon as they finish, rather than waiting behind a slow load
+	std::vector<std::shared_ptr<Job>> kept;
+	bool blocked = false;
+	// Indexed, since `apply` may submit more jobs
+	for (size_t k = 0; k < pending.size(); k++) {
+		std::shared_ptr<Job> job = pending[k];
+		if (!job->finished || (blocked && job->replacesBank)) {
+			if (job->replacesBank && !job->cancelled)
+				blocked = true;
+			kept.push_back(job);
+			continue;
+		}
+		if (!job->cancelled && job->apply)
+			job->apply();
+	}
+	pending = kept;
+}
+
+
+void jobsCancelAll() {
+	for (const std::shared_ptr<Job> &job : pending) {
+		job->cancelled = true;
+	}
+}
+
+
+void jobsCancelBankJobs() {
+	for (const std::shared_ptr<Job> &job : pending) {
+		if (job->replacesBank)
+			job->cancelled = true;
+	}
+}
+
+
+const std::vector<std::shared_ptr<Job>> &jobsPending() {
+	return pending;
+}
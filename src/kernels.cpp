@@ -0,0 +1,181 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+
+
+// Polynomial approximations
+// These are written without branches so the kernel loops below vectorize.
+
+#define FORCE_INLINE inline __attribute__((always_inline))
+
+/** roundf() which rounds halves away from zero
+Truncates and then steps away from zero on a fraction of a half or more, since adding 0.5 before truncating rounds 0.49999997 up to 1.
+Floats of magnitude 2^23 and above are already integers, and are clamped before the conversion so it cannot overflow.
+*/
+static FORCE_INLINE float fastroundf(float x) {
+	float c = fminf(fmaxf(x, -8388608.f), 8388608.f);
+	float t = (float)(int32_t) c;
+	t += (fabsf(c - t) >= 0.5f) ? copysignf(1.f, c) : 0.f;
+	return (fabsf(x) < 8388608.f) ? t : x;
+}
+
+/** sin(2 pi x), max error about 1e-7 for |x| < 2^23 */
+static FORCE_INLINE float fastsin2pif(float x) {
+	// Reduce to [-1/2, 1/2] cycles, then reflect to [-1/4, 1/4] about the peaks
+	x -= fastroundf(x);
+	float h = copysignf(0.5f, x);
+	x = (fabsf(x) > 0.25f) ? h - x : x;
+	float r = 2.f * (float)M_PI * x;
+	float r2 = r * r;
+	// Taylor series through r^11, truncation error < 6e-8 on [-pi/2, pi/2]
+	float p = -2.5052108e-8f;
+	p = p * r2 + 2.7557319e-6f;
+	p = p * r2 - 1.9841270e-4f;
+	p = p * r2 + 8.3333333e-3f;
+	p = p * r2 - 1.6666667e-1f;
+	return r + r * r2 * p;
+}
+
+/** asin(x) for |x| <= 1, max relative error about 2.5e-7
+From the Cephes library's asinf
+*/
+static FORCE_INLINE float fastasinf(float x) {
+	float a = fabsf(x);
+	// Small argument: asin(a) = a + a^3 P(a^2)
+	// Large argument: asin(a) = pi/2 - 2 asin(sqrt((1 - a) / 2))
+	bool large = a > 0.5f;
+	float z = large ? 0.5f * (1.f - a) : a * a;
+	float s = large ? sqrtf(z) : a;
+	float p = 4.2163199048e-2f;
+	p = p * z + 2.4181311049e-2f;
+	p = p * z + 4.5470025998e-2f;
+	p = p * z + 7.4953002686e-2f;
+	p = p * z + 1.6666752422e-1f;
+	float y = s + s * z * p;
+	y = large ? (float)M_PI_2 - 2.f * y : y;
+	return copysignf(y, x);
+}
+
+
+// Kernel bodies
+// Each is compiled once per instruction set below.
+
+static FORCE_INLINE void gainBody(float *x, int len, float gain) {
+	for (int i = 0; i < len; i++) {
+		x[i] *= gain;
+	}
+}
+
+static FORCE_INLINE void chebyshevBody(float *x, int len, float n) {
+	// Count the phase in cycles
+	float n2pi = n * (float)(0.5 * M_1_PI);
+	for (int i = 0; i < len; i++) {
+		// Out-of-range values are folded back with 1/x
+		float v = (-1.f <= x[i] && x[i] <= 1.f) ? x[i] : 1.f / x[i];
+		x[i] = fastsin2pif(n2pi * fastasinf(v));
+	}
+}
+
+static FORCE_INLINE void sampleAndHoldBody(float *x, int len, float frameskip) {
+	ArenaScope scope;
+	float *tmp = arenaArray<float>(len + 1);
+	memcpy(tmp, x, sizeof(float) * len);
+	tmp[len] = tmp[0];
+	// Dumb linear interpolation S&H
+	for (int i = 0; i < len; i++) {
+		float index = clampf(fastroundf(i / frameskip) * frameskip, 0.f, len - 1);
+		int indexi = index;
+		float indexf = index - indexi;
+		x[i] = tmp[indexi] + (tmp[indexi + 1] - tmp[indexi]) * indexf;
+	}
+}
+
+static FORCE_INLINE void quantizeBody(float *x, int len, float levels) {
+	float invLevels = 1.f / levels;
+	for (int i = 0; i < len; i++) {
+		x[i] = fastroundf(x[i] * levels) * invLevels;
+	}
+}
+
+static FORCE_INLINE void cycleBody(float *x, int len) {
+	float start = x[0];
+	float end = x[len - 1] / (len - 1) * len;
+	float slope = (end - start) / len;
+	for (int i = 0; i < len; i++) {
+		x[i] -= slope * (i - len / 2);
+	}
+}
+
+static FORCE_INLINE void normalizeBody(float *x, int len) {
+	float max = -INFINITY;
+	float min = INFINITY;
+	for (int i = 0; i < len; i++) {
+		max = fmaxf(max, x[i]);
+		min = fminf(min, x[i]);
+	}
+
+	if (max - min >= 1e-6f) {
+		float scale = 2.f / (max - min);
+		for (int i = 0; i < len; i++) {
+			x[i] = (x[i] - min) * scale - 1.f;
+		}
+	}
+	else {
+		memset(x, 0, sizeof(float) * len);
+	}
+}
+
+static FORCE_INLINE void clipBody(float *x, int len) {
+	for (int i = 0; i < len; i++) {
+		x[i] = fminf(fmaxf(x[i], -1.f), 1.f);
+	}
+}
+
+
+// Instruction set variants
+// There are no intrinsics here. Each variant compiles the same bodies, and the compiler vectorizes them for the target, which is why the bodies avoid branches.
+// `make bench` times the variants side by side, so a compiler which stops vectorizing them shows up there.
+
+#define DEFINE_KERNELS(isa, attr) \
+	attr static void gain_##isa(float *x, int len, float gain) { gainBody(x, len, gain); } \
+	attr static void chebyshev_##isa(float *x, int len, float n) { chebyshevBody(x, len, n); } \
+	attr static void sampleAndHold_##isa(float *x, int len, float frameskip) { sampleAndHoldBody(x, len, frameskip); } \
+	attr static void quantize_##isa(float *x, int len, float levels) { quantizeBody(x, len, levels); } \
+	attr static void cycle_##isa(float *x, int len) { cycleBody(x, len); } \
+	attr static void normalize_##isa(float *x, int len) { normalizeBody(x, len); } \
+	attr static void clip_##isa(float *x, int len) { clipBody(x, len); } \
+	static const EffectKernels kernels_##isa = { \
+		#isa, \
+		gain_##isa, \
+		chebyshev_##isa, \
+		sampleAndHold_##isa, \
+		quantize_##isa, \
+		cycle_##isa, \
+		normalize_##isa, \
+		clip_##isa, \
+	};
+
+DEFINE_KERNELS(generic, )
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define KERNELS_X86
+	DEFINE_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+#endif
+
+
+static const EffectKernels *selectKernels() {
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return &kernels_avx2;
+#endif
+	return &kernels_generic;
+}
+
+const EffectKernels *effectKernels() {
+	static const EffectKernels *kernels = selectKernels();
+	return kernels;
+}
+
+const EffectKernels *genericEffectKernels() {
+	return &kernels_generic;
+}
@@ -0,0 +1,215 @@
+#include "WaveEdit.hpp"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+
+// Each segment has two copies. Readers use the published one while the builder writes the other, so a frame is never read half rebuilt.
+// A read takes far less time than rebuilding a segment, so a reader is done with a copy before the builder comes back to it.
+
+/** Frames from wave j toward wave j + 1 */
+static float zFrames[BANK_LEN][2][LATTICE_STEPS][WAVE_LEN];
+/** Frames in the grid cell whose top-left wave is j, indexed by [y step][x step] */
+static float xyFrames[BANK_LEN][2][LATTICE_STEPS][LATTICE_STEPS][WAVE_LEN];
+/** Index of each segment's published copy, or -1 while it is stale. Read by the audio and UI threads without locking. */
+static std::atomic<int> zPublished[BANK_LEN];
+static std::atomic<int> xyPublished[BANK_LEN];
+/** The copy the builder writes next. Only touched by the builder. */
+static int zBack[BANK_LEN];
+static int xyBack[BANK_LEN];
+
+// The following are guarded by `mutex`
+static std::mutex mutex;
+static std::condition_variable cv;
+/** The bank the lattice is being built from */
+static BankPlanes *planes = NULL;
+/** Incremented when a segment is invalidated, so a segment built from stale data is not marked ready */
+static int zGeneration[BANK_LEN];
+static int xyGeneration[BANK_LEN];
+static bool running = false;
+static std::thread thread;
+
+
+static void invalidateWave(int j) {
+	// The two Z segments touching the wave
+	int zs[2] = {j, eucmodi(j - 1, BANK_LEN)};
+	for (int z : zs) {
+		zPublished[z] = -1;
+		zGeneration[z]++;
+	}
+	// The four grid cells touching the wave
+	int x = j % BANK_GRID_WIDTH;
+	int y = j / BANK_GRID_WIDTH;
+	for (int dy = 0; dy <= 1; dy++) {
+		for (int dx = 0; dx <= 1; dx++) {
+			int cell = eucmodi(y - dy, BANK_GRID_HEIGHT) * BANK_GRID_WIDTH + eucmodi(x - dx, BANK_GRID_WIDTH);
+			xyPublished[cell] = -1;
+			xyGeneration[cell]++;
+		}
+	}
+}
+
+
+static void buildZ(BankPlanes *snapshot, int j) {
+	for (int s = 0; s < LATTICE_STEPS; s++) {
+		snapshot->morphSpectralZ(j + (float) s / LATTICE_STEPS, zFrames[j][zBack[j]][s]);
+	}
+}
+
+
+static void buildXY(BankPlanes *snapshot, int j) {
+	int x = j % BANK_GRID_WIDTH;
+	int y = j / BANK_GRID_WIDTH;
+	for (int sy = 0; sy < LATTICE_STEPS; sy++) {
+		for (int sx = 0; sx < LATTICE_STEPS; sx++) {
+			snapshot->morphSpectralXY(x + (float) sx / LATTICE_STEPS, y + (float) sy / LATTICE_STEPS, xyFrames[j][xyBack[j]][sy][sx]);
+		}
+	}
+}
+
+
+static void latticeRun() {
+	BankPlanes *snapshot = new BankPlanes();
+	std::unique_lock<std::mutex> lock(mutex);
+	while (running) {
+		// Find stale segments
+		int zStale[BANK_LEN];
+		int xyStale[BANK_LEN];
+		bool stale = false;
+		for (int j = 0; j < BANK_LEN; j++) {
+			zStale[j] = (zPublished[j] >= 0) ? -1 : zGeneration[j];
+			xyStale[j] = (xyPublished[j] >= 0) ? -1 : xyGeneration[j];
+			stale = stale || zStale[j] >= 0 || xyStale[j] >= 0;
+		}
+		if (!stale) {
+			cv.wait(lock);
+			continue;
+		}
+
+		// Build without holding the lock, so latticeUpdate() never waits on the FFTs
+		*snapshot = *planes;
+		lock.unlock();
+		parallelFor(0, BANK_LEN, [&](int j) {
+			if (zStale[j] >= 0)
+				buildZ(snapshot, j);
+			if (xyStale[j] >= 0)
+				buildXY(snapshot, j);
+		});
+		lock.lock();
+
+		// Publish the segments which were not invalidated during the build, and write their other copy next time
+		for (int j = 0; j < BANK_LEN; j++) {
+			if (zStale[j] >= 0 && zStale[j] == zGeneration[j]) {
+				zPublished[j].store(zBack[j], std::memory_order_release);
+				zBack[j] = 1 - zBack[j];
+			}
+			if (xyStale[j] >= 0 && xyStale[j] == xyGeneration[j]) {
+				xyPublished[j].store(xyBack[j], std::memory_order_release);
+				xyBack[j] = 1 - xyBack[j];
+			}
+		}
+	}
+	delete snapshot;
+}
+
+
+void latticeInit() {
+	std::lock_guard<std::mutex> lock(mutex);
+	planes = new BankPlanes();
+	// Zeroed planes match a cleared bank, so build everything once
+	for (int j = 0; j < BANK_LEN; j++) {
+		invalidateWave(j);
+	}
+	running = true;
+	thread = std::thread(latticeRun);
+}
+
+
+void latticeDestroy() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		cv.notify_one();
+	}
+	thread.join();
+	delete planes;
+	planes = NULL;
+}
+
+
+void latticeUpdate(Bank *bank) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!planes)
+		return;
+	bool changed = false;
+	for (int j = 0; j < BANK_LEN; j++) {
+		if (planes->versions[j] == bank->waves[j].version)
+			continue;
+		invalidateWave(j);
+		changed = true;
+	}
+	if (!changed)
+		return;
+	planes->load(bank);
+	cv.notify_one();
+}
+
+
+/** Returns the frame at lattice index `z` on [0, BANK_LEN * LATTICE_STEPS), or NULL if its segment is stale */
+static const float *zFrame(int z) {
+	z = eucmodi(z, BANK_LEN * LATTICE_STEPS);
+	int j = z / LATTICE_STEPS;
+	int k = zPublished[j].load(std::memory_order_acquire);
+	if (k < 0)
+		return NULL;
+	return zFrames[j][k][z % LATTICE_STEPS];
+}
+
+
+static const float *xyFrame(int x, int y) {
+	x = eucmodi(x, BANK_GRID_WIDTH * LATTICE_STEPS);
+	y = eucmodi(y, BANK_GRID_HEIGHT * LATTICE_STEPS);
+	int j = (y / LATTICE_STEPS) * BANK_GRID_WIDTH + (x / LATTICE_STEPS);
+	int k = xyPublished[j].load(std::memory_order_acquire);
+	if (k < 0)
+		return NULL;
+	return xyFrames[j][k][y % LATTICE_STEPS][x % LATTICE_STEPS];
+}
+
+
+bool latticeMorphZ(float z, float *out) {
+	float l = z * LATTICE_STEPS;
+	int li = l;
+	float lf = l - li;
+	const float *a = zFrame(li);
+	const float *b = zFrame(li + 1);
+	if (!a || !b)
+		return false;
+	// Neighbouring frames are close enough in spectrum to crossfade
+	for (int i = 0; i < WAVE_LEN; i++) {
+		out[i] = a[i] + (b[i] - a[i]) * lf;
+	}
+	return true;
+}
+
+
+bool latticeMorphXY(float x, float y, float *out) {
+	float lx = x * LATTICE_STEPS;
+	float ly = y * LATTICE_STEPS;
+	int xi = lx;
+	float xf = lx - xi;
+	int yi = ly;
+	float yf = ly - yi;
+	const float *a = xyFrame(xi, yi);
+	const float *b = xyFrame(xi + 1, yi);
+	const float *c = xyFrame(xi, yi + 1);
+	const float *d = xyFrame(xi + 1, yi + 1);
+	if (!a || !b || !c || !d)
+		return false;
+	for (int i = 0; i < WAVE_LEN; i++) {
+		float v0 = a[i] + (b[i] - a[i]) * xf;
+		float v1 = c[i] + (d[i] - c[i]) * xf;
+		out[i] = v0 + (v1 - v0) * yf;
+	}
+	return true;
+}
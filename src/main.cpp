@@ -81,7 +81,9 @@ int main(int argc, char **argv) {
 	historyClear();
 	currentBank.load("autosave.dat");
 	historyPush();
+	autosaveInit("autosave.dat");
 	audioInit();
+	jobsInit();
 
 	// Main loop
 	bool running = true;
@@ -94,6 +96,8 @@ int main(int argc, char **argv) {
 				running = false;
 			}
 		}
+		// Apply finished jobs before the frame draws from the bank
+		jobsUpdate();
 
 		// Set title
 		const char *title = SDL_GetWindowTitle(window);
@@ -123,6 +127,8 @@ int main(int argc, char **argv) {
 			// Build render buffer
 			uiRender();
 		}
+		audioUpdate();
+		autosaveUpdate();
 
 		// Render frame
 		glViewport(0, 0, (int)ImGui::GetIO().DisplaySize.x, (int)ImGui::GetIO().DisplaySize.y);
@@ -131,9 +137,15 @@ int main(int argc, char **argv) {
 		glClear(GL_COLOR_BUFFER_BIT);
 		ImGui::Render();
 		SDL_GL_SwapWindow(window);
+		// Frees the UI thread's temporaries
+		arenaFrameEnd();
 	}
 
-	currentBank.save("autosave.dat");
+	jobsDestroy();
+	autosaveDestroy();
+	// Joins the lattice builder, which runs its builds on the pool
+	audioDestroy();
+	poolDestroy();
 
 	// Cleanup
 	uiDestroy();
@@ -2,17 +2,28 @@
 #include <string.h>
 #include "pffft/pffft.h"
 #include <samplerate.h>
+#include <mutex>
 
 
-static void FFT(const float *in, float *out, int len, bool inverse) {
+/** Setups are read-only once created, so every thread shares one per length */
+static PFFFT_Setup *fftSetup(int len) {
+	static std::mutex mutex;
+	static std::vector<std::pair<int, PFFFT_Setup*>> setups;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const std::pair<int, PFFFT_Setup*> &setup : setups) {
+		if (setup.first == len)
+			return setup.second;
+	}
 	PFFFT_Setup *setup = pffft_new_setup(len, PFFFT_REAL);
-	float *work = NULL;
-	if (len >= 4096)
-		work = (float*)pffft_aligned_malloc(sizeof(float) * len);
-	pffft_transform_ordered(setup, in, out, work, inverse ? PFFFT_BACKWARD : PFFFT_FORWARD);
-	pffft_destroy_setup(setup);
-	if (work)
-		pffft_aligned_free(work);
+	setups.push_back(std::make_pair(len, setup));
+	return setup;
+}
+
+
+static void FFT(const float *in, float *out, int len, bool inverse) {
+	// Large transforms need a work buffer, which is kept per thread
+	float *work = (len >= 4096) ? threadScratch(SCRATCH_FFT_WORK, len) : NULL;
+	pffft_transform_ordered(fftSetup(len), in, out, work, inverse ? PFFFT_BACKWARD : PFFFT_FORWARD);
 }
 
 
@@ -31,7 +42,104 @@ void IRFFT(const float *in, float *out, int len) {
 }
 
 
-int resample(const float *in, int inLen, float *out, int outLen, double ratio) {
+/** Plans are created on first use and live for the duration of the process */
+template <int LEN>
+static PFFFT_Setup *fftSetup() {
+	static PFFFT_Setup *setup = pffft_new_setup(LEN, PFFFT_REAL);
+	return setup;
+}
+
+template <int LEN>
+void RFFT(const float *in, float *out) {
+	static_assert(LEN < 4096, "pffft requires a work buffer for large transforms");
+	pffft_transform_ordered(fftSetup<LEN>(), in, out, NULL, PFFFT_FORWARD);
+	const float a = 1.0 / LEN;
+	for (int i = 0; i < LEN; i++) {
+		out[i] *= a;
+	}
+}
+
+template <int LEN>
+void IRFFT(const float *in, float *out) {
+	pffft_transform_ordered(fftSetup<LEN>(), in, out, NULL, PFFFT_BACKWARD);
+}
+
+
+// src_simple() creates and destroys a converter on every call, which the import page does every frame.
+// Converters are instead kept in a pool per quality and reset between uses.
+static std::mutex srcPoolMutex;
+static std::vector<SRC_STATE*> srcPools[RESAMPLE_QUALITIES_LEN];
+
+int srcConverterType(ResampleQuality quality) {
+	switch (quality) {
+		case RESAMPLE_SINC_MEDIUM: return SRC_SINC_MEDIUM_QUALITY;
+		case RESAMPLE_SINC_BEST: return SRC_SINC_BEST_QUALITY;
+		default: return SRC_SINC_FASTEST;
+	}
+}
+
+static SRC_STATE *srcAcquire(ResampleQuality quality) {
+	{
+		std::lock_guard<std::mutex> lock(srcPoolMutex);
+		std::vector<SRC_STATE*> &pool = srcPools[quality];
+		if (!pool.empty()) {
+			SRC_STATE *state = pool.back();
+			pool.pop_back();
+			return state;
+		}
+	}
+	int err;
+	return src_new(srcConverterType(quality), 1, &err);
+}
+
+static void srcRelease(SRC_STATE *state, ResampleQuality quality) {
+	src_reset(state);
+	std::lock_guard<std::mutex> lock(srcPoolMutex);
+	srcPools[quality].push_back(state);
+}
+
+
+/** Catmull-Rom spline through the four nearest samples of `in` at fractional position `x`, holding the end samples */
+static inline float interpolateCubic(const float *in, int len, double x) {
+	int i = x;
+	float t = x - i;
+	float y0 = in[clampi(i - 1, 0, len - 1)];
+	float y1 = in[clampi(i, 0, len - 1)];
+	float y2 = in[clampi(i + 1, 0, len - 1)];
+	float y3 = in[clampi(i + 2, 0, len - 1)];
+	float c1 = 0.5 * (y2 - y0);
+	float c2 = y0 - 2.5 * y1 + 2.0 * y2 - 0.5 * y3;
+	float c3 = 0.5 * (y3 - y0) + 1.5 * (y1 - y2);
+	return ((c3 * t + c2) * t + c1) * t + y1;
+}
+
+
+const char *resampleQualityNames[RESAMPLE_QUALITIES_LEN] = {
+	"Cubic",
+	"Sinc (Fastest)",
+	"Sinc (Medium)",
+	"Sinc (Best)",
+};
+
+
+int resample(const float *in, int inLen, float *out, int outLen, double ratio, ResampleQuality quality) {
+	if (inLen <= 0)
+		return 0;
+
+	// The cubic interpolator needs no state, but it aliases when downsampling
+	if (quality == RESAMPLE_CUBIC) {
+		int len = mini(outLen, (int) (inLen * ratio));
+		double step = 1.0 / ratio;
+		for (int i = 0; i < len; i++) {
+			out[i] = interpolateCubic(in, inLen, i * step);
+		}
+		return len;
+	}
+
+	SRC_STATE *state = srcAcquire(quality);
+	if (!state)
+		return 0;
+
 	SRC_DATA data;
 	// Old versions of libsamplerate don't use const here
 	data.data_in = (float*) in;
@@ -40,19 +148,22 @@ int resample(const float *in, int inLen, float *out, int outLen, double ratio) {
 	data.output_frames = outLen;
 	data.end_of_input = true;
 	data.src_ratio = ratio;
-	src_simple(&data, SRC_SINC_FASTEST, 1);
+	src_process(state, &data);
+
+	srcRelease(state, quality);
 	return data.output_frames_gen;
 }
 
 
 void cyclicOversample(const float *in, float *out, int len, int oversample) {
-	float x[len * oversample];
-	memset(x, 0, sizeof(x));
+	ArenaScope scope;
+	float *x = arenaArray<float>(len * oversample);
+	memset(x, 0, sizeof(float) * len * oversample);
 	// Zero-stuff oversampled buffer
 	for (int i = 0; i < len; i++) {
 		x[i * oversample] = in[i] * oversample;
 	}
-	float fft[len * oversample];
+	float *fft = arenaArray<float>(len * oversample);
 	RFFT(x, fft, len * oversample);
 
 	// Apply brick wall filter
@@ -68,14 +179,91 @@ void cyclicOversample(const float *in, float *out, int len, int oversample) {
 }
 
 
-void i16_to_f32(const int16_t *in, float *out, int length) {
-	for (int i = 0; i < length; i++) {
-		out[i] = in[i] / 32767.f;
+template <int LEN, int OVERSAMPLE>
+void cyclicOversample(const float *in, float *out) {
+	const int outLen = LEN * OVERSAMPLE;
+	float x[outLen] = {};
+	// Zero-stuff oversampled buffer
+	for (int i = 0; i < LEN; i++) {
+		x[i * OVERSAMPLE] = in[i] * OVERSAMPLE;
+	}
+	float fft[outLen];
+	RFFT<outLen>(x, fft);
+
+	// Apply brick wall filter
+	// y_{N/2} = 0
+	fft[1] = 0.0;
+	// y_k = 0 for k >= len
+	for (int i = LEN / 2; i < outLen / 2; i++) {
+		fft[2*i] = 0.0;
+		fft[2*i + 1] = 0.0;
 	}
+
+	IRFFT<outLen>(fft, out);
 }
-void f32_to_i16(const float *in, int16_t *out, int length) {
-	for (int i = 0; i < length; i++) {
-		// The following line has an incredible amount of controversy among DSP enthusiasts.
-		out[i] = roundf(clampf(in[i], -1.0, 1.0) * 32767.f);
+
+
+template <int LEN, int OVERSAMPLE>
+void cyclicDownsample(const float *in, float *out) {
+	const int inLen = LEN * OVERSAMPLE;
+	float fft[inLen];
+	RFFT<inLen>(in, fft);
+	// Keep the harmonics below the new Nyquist frequency
+	// IRFFT is unnormalized, so the amplitude is preserved at the shorter length
+	fft[1] = 0.0;
+	IRFFT<LEN>(fft, out);
+}
+
+
+template void RFFT<128>(const float *in, float *out);
+template void RFFT<256>(const float *in, float *out);
+template void RFFT<512>(const float *in, float *out);
+template void RFFT<1024>(const float *in, float *out);
+template void RFFT<2048>(const float *in, float *out);
+template void IRFFT<128>(const float *in, float *out);
+template void IRFFT<256>(const float *in, float *out);
+template void IRFFT<512>(const float *in, float *out);
+template void IRFFT<1024>(const float *in, float *out);
+template void IRFFT<2048>(const float *in, float *out);
+template void cyclicOversample<128, 2>(const float *in, float *out);
+template void cyclicOversample<128, 4>(const float *in, float *out);
+template void cyclicOversample<128, 8>(const float *in, float *out);
+template void cyclicOversample<128, 16>(const float *in, float *out);
+template void cyclicOversample<256, 4>(const float *in, float *out);
+template void cyclicOversample<256, 8>(const float *in, float *out);
+template void cyclicDownsample<128, 4>(const float *in, float *out);
+template void cyclicDownsample<128, 8>(const float *in, float *out);
+template void cyclicDownsample<256, 4>(const float *in, float *out);
+template void cyclicDownsample<256, 8>(const float *in, float *out);
+
+
+void cyclicResample(const float *in, int inLen, float *out, int outLen) {
+	ArenaScope scope;
+	float *inFft = arenaArray<float>(inLen);
+	RFFT(in, inFft, inLen);
+
+	// Keep harmonics below both Nyquist frequencies
+	float *outFft = arenaArray<float>(outLen);
+	memset(outFft, 0, sizeof(float) * outLen);
+	int bins = mini(inLen, outLen) / 2;
+	outFft[0] = inFft[0];
+	for (int k = 1; k < bins; k++) {
+		outFft[2*k] = inFft[2*k];
+		outFft[2*k + 1] = inFft[2*k + 1];
 	}
+
+	IRFFT(outFft, out, outLen);
 }
+
+
+void *alignedMalloc(size_t size) {
+	return pffft_aligned_malloc(size);
+}
+
+
+void alignedFree(void *ptr) {
+	if (ptr)
+		pffft_aligned_free(ptr);
+}
+
+
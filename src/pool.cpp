@@ -0,0 +1,233 @@
+#include "WaveEdit.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+
+struct Task {
+	std::function<void()> work;
+	TaskGroup *group;
+};
+
+/** Each thread pushes and pops its own tasks at the back, and idle threads steal from the front */
+struct TaskQueue {
+	std::mutex mutex;
+	std::deque<Task> tasks;
+};
+
+// The queues and locks are never freed, so a task group used after poolDestroy() still runs its tasks on the thread which waits
+static int workersLen = 0;
+static std::vector<std::thread> *workers = NULL;
+/** One queue per worker, plus one shared by threads outside the pool */
+static TaskQueue *queues = NULL;
+/** Index of the current thread's queue */
+static thread_local int queueId = -1;
+
+/** Number of tasks in all queues, for idle workers to sleep on */
+static std::atomic<int> queued(0);
+static std::mutex *sleepMutex = NULL;
+static std::condition_variable *sleepCv = NULL;
+/** Notified under `sleepMutex` when a group's last task finishes */
+static std::condition_variable *finishedCv = NULL;
+/** Set by poolDestroy() to let the workers return */
+static bool stopping = false;
+
+
+/** Takes a task from the current thread's queue, or steals one from another
+If `group` is not NULL, only its tasks are taken.
+*/
+static bool popTask(Task *task, TaskGroup *group) {
+	int self = (queueId >= 0) ? queueId : workersLen;
+	// Newest task of our own, which is likely still in cache
+	{
+		TaskQueue &q = queues[self];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		for (auto it = q.tasks.rbegin(); it != q.tasks.rend(); it++) {
+			if (group && it->group != group)
+				continue;
+			*task = std::move(*it);
+			q.tasks.erase(std::next(it).base());
+			queued--;
+			return true;
+		}
+	}
+	// Oldest task of another thread, which is likely the largest
+	for (int i = 1; i <= workersLen; i++) {
+		TaskQueue &q = queues[(self + i) % (workersLen + 1)];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		for (auto it = q.tasks.begin(); it != q.tasks.end(); it++) {
+			if (group && it->group != group)
+				continue;
+			*task = std::move(*it);
+			q.tasks.erase(it);
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static void runTask(Task &task) {
+	{
+		// Workers never see a frame boundary, so each task releases its arena allocations when it returns
+		ArenaScope scope;
+		task.work();
+	}
+	// The waiting thread may destroy the group as soon as it sees 0, so it is not touched after this
+	if (--task.group->pending == 0) {
+		std::lock_guard<std::mutex> lock(*sleepMutex);
+		finishedCv->notify_all();
+	}
+}
+
+
+static void workerRun(int id) {
+	queueId = id;
+	while (true) {
+		Task task;
+		if (popTask(&task, NULL)) {
+			runTask(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(*sleepMutex);
+		sleepCv->wait(lock, []() { return queued > 0 || stopping; });
+		if (stopping && queued == 0)
+			return;
+	}
+}
+
+
+/** Starts the workers on first use. They run until poolDestroy(). */
+static void poolStart() {
+	static std::once_flag once;
+	std::call_once(once, []() {
+		// The thread which waits on a task group also runs tasks, so leave it a core
+		workersLen = maxi((int) std::thread::hardware_concurrency() - 1, 1);
+		queues = new TaskQueue[workersLen + 1];
+		sleepMutex = new std::mutex();
+		sleepCv = new std::condition_variable();
+		finishedCv = new std::condition_variable();
+		workers = new std::vector<std::thread>();
+		for (int i = 0; i < workersLen; i++) {
+			workers->push_back(std::thread(workerRun, i));
+		}
+	});
+}
+
+
+void poolDestroy() {
+	if (!workers)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(*sleepMutex);
+		stopping = true;
+	}
+	sleepCv->notify_all();
+	// Workers drain the queued tasks before they return
+	for (std::thread &worker : *workers) {
+		worker.join();
+	}
+	workers->clear();
+}
+
+
+int poolThreads() {
+	poolStart();
+	return workersLen + 1;
+}
+
+
+TaskGroup::~TaskGroup() {
+	wait();
+}
+
+
+void TaskGroup::run(std::function<void()> work) {
+	poolStart();
+	pending++;
+	Task task;
+	task.work = std::move(work);
+	task.group = this;
+	TaskQueue &q = queues[(queueId >= 0) ? queueId : workersLen];
+	{
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.tasks.push_back(std::move(task));
+	}
+	queued++;
+	{
+		// Taking the lock orders this with a worker's check of `queued` before it sleeps
+		std::lock_guard<std::mutex> lock(*sleepMutex);
+	}
+	sleepCv->notify_one();
+}
+
+
+void TaskGroup::wait() {
+	// Run queued tasks rather than block, so nested groups on worker threads cannot deadlock
+	// Only this group's tasks are taken, so the UI thread never picks up a long job while waiting on a short parallelFor()
+	while (pending > 0) {
+		Task task;
+		if (popTask(&task, this)) {
+			runTask(task);
+			continue;
+		}
+		// The rest of the group is running on other threads
+		std::unique_lock<std::mutex> lock(*sleepMutex);
+		finishedCv->wait(lock, [this]() { return pending == 0; });
+	}
+}
+
+
+void parallelFor(int begin, int end, std::function<void(int)> work) {
+	int count = end - begin;
+	if (count <= 0)
+		return;
+	if (count == 1) {
+		work(begin);
+		return;
+	}
+
+	// Each task takes the next index until none are left, so uneven work balances out
+	std::atomic<int> next(begin);
+	auto worker = [&]() {
+		int i;
+		while ((i = next++) < end) {
+			work(i);
+		}
+	};
+	TaskGroup group;
+	int tasksLen = mini(poolThreads(), count);
+	for (int t = 1; t < tasksLen; t++) {
+		group.run(worker);
+	}
+	// The calling thread does its share too
+	worker();
+	group.wait();
+}
+
+
+/** Buffers owned by one thread, freed when it exits */
+struct ScratchArena {
+	float *buffers[SCRATCH_SLOTS_LEN] = {};
+	int lens[SCRATCH_SLOTS_LEN] = {};
+
+	~ScratchArena() {
+		for (int i = 0; i < SCRATCH_SLOTS_LEN; i++) {
+			alignedFree(buffers[i]);
+		}
+	}
+};
+
+static thread_local ScratchArena scratchArena;
+
+
+float *threadScratch(ScratchSlot slot, int len) {
+	ScratchArena &arena = scratchArena;
+	if (arena.lens[slot] < len) {
+		alignedFree(arena.buffers[slot]);
+		arena.buffers[slot] = (float*) alignedMalloc(sizeof(float) * len);
+		arena.lens[slot] = len;
+	}
+	return arena.buffers[slot];
+}
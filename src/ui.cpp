@@ -37,6 +37,8 @@ enum Page {
 	EFFECT_PAGE,
 	WATERFALL_PAGE,
 	IMPORT_PAGE,
+	GENERATOR_PAGE,
+	HARMONICS_PAGE,
 	NUM_PAGES
 };
 
@@ -112,6 +114,7 @@ static void showCurrentBankPage() {
 	switch (currentPage) {
 		case EFFECT_PAGE:
 		case IMPORT_PAGE:
+		case GENERATOR_PAGE:
 			currentPage = EDITOR_PAGE;
 			break;
 		default:
@@ -126,6 +129,7 @@ static void menuManual() {
 static void menuNewBank() {
 	showCurrentBankPage();
 	currentBank.clear();
+	bankGeneration++;
 	lastFilename[0] = '\0';
 	historyPush();
 }
@@ -148,9 +152,18 @@ static void menuOpenBank() {
 	char *path = osdialog_file(OSDIALOG_OPEN, dir, NULL, NULL);
 	if (path) {
 		showCurrentBankPage();
-		currentBank.loadWAV(path);
-		snprintf(lastFilename, sizeof(lastFilename), "%s", path);
-		historyPush();
+		std::string filename = path;
+		std::shared_ptr<Bank> bank = std::make_shared<Bank>();
+		// Only the bank opened last should land
+		jobsCancelBankJobs();
+		jobsSubmit("Opening bank", [=](Job *job) {
+			bank->loadWAV(filename.c_str());
+		}, [=]() {
+			currentBank = *bank;
+			bankGeneration++;
+			snprintf(lastFilename, sizeof(lastFilename), "%s", filename.c_str());
+			historyPush();
+		})->replacesBank = true;
 		free(path);
 	}
 	free(dir);
@@ -174,16 +187,113 @@ static void menuSaveBank() {
 		menuSaveBankAs();
 }
 
+static void showExportStats(ExportStats stats) {
+	char message[1024];
+	snprintf(message, sizeof(message), "Exported %d files, %.1f kB in %.1f ms (%.1f MB/s)",
+		stats.files, stats.bytes / 1e3, stats.seconds * 1e3, stats.bytes / 1e6 / fmax(stats.seconds, 1e-6));
+	osdialog_message(OSDIALOG_INFO, OSDIALOG_OK, message);
+}
+
 static void menuSaveWaves() {
 	char *dir = getLastDir();
 	char *path = osdialog_file(OSDIALOG_OPEN_DIR, dir, NULL, NULL);
 	if (path) {
-		currentBank.saveWaves(path);
+		showExportStats(exportWaves(&currentBank, path, exportFormat));
+		free(path);
+	}
+	free(dir);
+}
+
+static void menuExportLibrary(bool archive) {
+	char *dir = getLastDir();
+	// Choose the folder of banks to export, then the destination
+	char *inPath = osdialog_file(OSDIALOG_OPEN_DIR, dir, NULL, NULL);
+	if (inPath) {
+		char *outPath = archive ? osdialog_file(OSDIALOG_SAVE, dir, "Library.tar", NULL) : osdialog_file(OSDIALOG_OPEN_DIR, dir, NULL, NULL);
+		if (outPath && !archive && !strcmp(inPath, outPath)) {
+			osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Choose a different folder to export to, since the banks would be overwritten.");
+		}
+		else if (outPath) {
+			std::vector<std::string> paths = listBankFiles(inPath);
+			std::string out = outPath;
+			ExportFormat format = exportFormat;
+			std::shared_ptr<ExportStats> stats = std::make_shared<ExportStats>();
+			jobsSubmit("Exporting library", [=](Job *job) {
+				*stats = exportLibrary(paths, out.c_str(), format, archive);
+			}, [=]() {
+				showExportStats(*stats);
+			});
+		}
+		free(outPath);
+		free(inPath);
+	}
+	free(dir);
+}
+
+static void menuOpenWavetable(const WavetableGeometry *geometry) {
+	char *dir = getLastDir();
+	char *path = osdialog_file(OSDIALOG_OPEN, dir, NULL, NULL);
+	if (path) {
+		showCurrentBankPage();
+		std::string filename = path;
+		int waveLen = geometry->waveLen;
+		std::shared_ptr<Bank> bank = std::make_shared<Bank>();
+		jobsCancelBankJobs();
+		jobsSubmit("Opening wavetable", [=](Job *job) {
+			Wavetable wavetable;
+			if (!wavetable.loadWAV(filename.c_str(), waveLen)) {
+				// Leave the bank and the undo history alone
+				job->cancelled = true;
+				return;
+			}
+			job->progress = 0.5;
+			wavetable.toBank(bank.get());
+		}, [=]() {
+			currentBank = *bank;
+			bankGeneration++;
+			historyPush();
+		})->replacesBank = true;
+		free(path);
+	}
+	free(dir);
+}
+
+static void menuExportWavetable(const WavetableGeometry *geometry, bool raw) {
+	char *dir = getLastDir();
+	char *path = osdialog_file(OSDIALOG_SAVE, dir, raw ? "Untitled.raw" : "Untitled.wav", NULL);
+	if (path) {
+		exportWavetable(&currentBank, path, *geometry, exportFormat, raw);
 		free(path);
 	}
 	free(dir);
 }
 
+static void menuExportWavetableLibrary(const WavetableGeometry *geometry, bool raw) {
+	char *dir = getLastDir();
+	char *inPath = osdialog_file(OSDIALOG_OPEN_DIR, dir, NULL, NULL);
+	if (inPath) {
+		char *outPath = osdialog_file(OSDIALOG_OPEN_DIR, dir, NULL, NULL);
+		if (outPath && !raw && !strcmp(inPath, outPath)) {
+			osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Choose a different folder to export to, since the banks would be overwritten.");
+		}
+		else if (outPath) {
+			std::vector<std::string> paths = listBankFiles(inPath);
+			std::string out = outPath;
+			WavetableGeometry g = *geometry;
+			ExportFormat format = exportFormat;
+			std::shared_ptr<ExportStats> stats = std::make_shared<ExportStats>();
+			jobsSubmit("Exporting wavetable library", [=](Job *job) {
+				*stats = exportWavetableLibrary(paths, out.c_str(), g, format, raw);
+			}, [=]() {
+				showExportStats(*stats);
+			});
+		}
+		free(outPath);
+		free(inPath);
+	}
+	free(dir);
+}
+
 static void menuQuit() {
 	SDL_Event event;
 	event.type = SDL_QUIT;
@@ -279,6 +389,10 @@ static void menuKeyCommands() {
 				currentPage = WATERFALL_PAGE;
 			if (ImGui::IsKeyPressed(SDLK_4))
 				currentPage = IMPORT_PAGE;
+			if (ImGui::IsKeyPressed(SDLK_5))
+				currentPage = GENERATOR_PAGE;
+			if (ImGui::IsKeyPressed(SDLK_6))
+				currentPage = HARMONICS_PAGE;
 			if (ImGui::IsKeyPressed(SDL_SCANCODE_UP))
 				incrementSelectedId(-1);
 			if (ImGui::IsKeyPressed(SDL_SCANCODE_DOWN))
@@ -364,6 +478,48 @@ void renderMenu() {
 				menuSaveBankAs();
 			if (ImGui::MenuItem("Save Waves to Folder...", NULL))
 				menuSaveWaves();
+			if (ImGui::MenuItem("Export Library to Folder...", NULL))
+				menuExportLibrary(false);
+			if (ImGui::MenuItem("Export Library to Archive...", NULL))
+				menuExportLibrary(true);
+			if (ImGui::BeginMenu("Export Format")) {
+				for (int i = 0; i < EXPORT_FORMATS_LEN; i++) {
+					if (ImGui::MenuItem(exportFormatNames[i], NULL, exportFormat == i))
+						exportFormat = (ExportFormat) i;
+				}
+				ImGui::Separator();
+				if (ImGui::MenuItem("Dither 16-bit", NULL, exportDither))
+					exportDither = !exportDither;
+				ImGui::EndMenu();
+			}
+			if (ImGui::BeginMenu("Open Wavetable")) {
+				for (int i = 0; i < wavetableGeometriesLen; i++) {
+					if (ImGui::MenuItem(wavetableGeometries[i].name))
+						menuOpenWavetable(&wavetableGeometries[i]);
+				}
+				ImGui::EndMenu();
+			}
+			if (ImGui::BeginMenu("Export Wavetable")) {
+				for (int i = 0; i < wavetableGeometriesLen; i++) {
+					if (ImGui::MenuItem(wavetableGeometries[i].name))
+						menuExportWavetable(&wavetableGeometries[i], false);
+				}
+				ImGui::EndMenu();
+			}
+			if (ImGui::BeginMenu("Export Raw Wavetable")) {
+				for (int i = 0; i < wavetableGeometriesLen; i++) {
+					if (ImGui::MenuItem(wavetableGeometries[i].name))
+						menuExportWavetable(&wavetableGeometries[i], true);
+				}
+				ImGui::EndMenu();
+			}
+			if (ImGui::BeginMenu("Export Library as Wavetables")) {
+				for (int i = 0; i < wavetableGeometriesLen; i++) {
+					if (ImGui::MenuItem(wavetableGeometries[i].name))
+						menuExportWavetableLibrary(&wavetableGeometries[i], false);
+				}
+				ImGui::EndMenu();
+			}
 			if (ImGui::MenuItem("Quit", ImGui::GetIO().OSXBehaviors ? "Cmd+Q" : "Ctrl+Q"))
 				menuQuit();
 
@@ -407,6 +563,11 @@ void renderMenu() {
 			if (ImGui::MenuItem("Manual PDF", "F1", false))
 				menuManual();
 			// if (ImGui::MenuItem("imgui Demo", NULL, showTestWindow)) showTestWindow = !showTestWindow;
+			ImGui::Separator();
+			// Profiler counters, for spotting per-frame allocation churn
+			std::string arenaText = stringf("Frame arena: %d allocations, %.1f kB, %d from heap",
+				arenaFrameStats.allocations, arenaFrameStats.bytes / 1e3, arenaFrameStats.heapAllocations);
+			ImGui::MenuItem(arenaText.c_str(), NULL, false, false);
 			ImGui::EndMenu();
 		}
 		ImGui::EndMenuBar();
@@ -424,6 +585,8 @@ void renderPreview() {
 	ImGui::SliderFloat("##playFrequency", &playFrequency, 1.0f, 10000.0f, "Frequency: %.2f Hz", 0.0f);
 
 	ImGui::Checkbox("Morph Interpolate", &morphInterpolate);
+	ImGui::SameLine();
+	ImGui::Checkbox("Spectral Morph", &morphSpectral);
 	if (playModeXY) {
 		ImGui::SameLine();
 		ImGui::PushItemWidth(-1.0);
@@ -496,10 +659,8 @@ void editorPage() {
 		renderToolSelector(&tool);
 
 		ImGui::Text("Waveform");
-		const int oversample = 4;
-		float waveOversample[WAVE_LEN * oversample];
-		cyclicOversample(wave->postSamples, waveOversample, WAVE_LEN, oversample);
-		if (renderWave("WaveEditor", 200.0, wave->samples, WAVE_LEN, waveOversample, WAVE_LEN * oversample, tool)) {
+		const float *waveOversample = getDisplayCurve(&currentBank, selectedId);
+		if (renderWave("WaveEditor", 200.0, wave->samples, WAVE_LEN, waveOversample, WAVE_LEN * DISPLAY_OVERSAMPLE, tool)) {
 			currentBank.waves[selectedId].commitSamples();
 			historyPush();
 		}
@@ -546,11 +707,31 @@ void editorPage() {
 }
 
 
+/** The page of the drag open as one undo step, or -1 */
+static int strokePage = -1;
+
+/** Opens an undo step for a drag, if one is not already open */
+static void strokeBegin() {
+	if (strokePage >= 0)
+		return;
+	historyBegin();
+	strokePage = currentPage;
+}
+
+/** Commits the open drag, on mouse release or when the page is left */
+static void strokeEnd() {
+	if (strokePage < 0)
+		return;
+	strokePage = -1;
+	historyCommit();
+}
+
+
 void effectHistogram(EffectID effect, Tool tool) {
 	float value[BANK_LEN];
+	currentBank.getEffect(effect, value);
 	float average = 0.0;
 	for (int i = 0; i < BANK_LEN; i++) {
-		value[i] = currentBank.waves[i].effects[effect];
 		average += value[i];
 	}
 	average /= BANK_LEN;
@@ -565,7 +746,9 @@ void effectHistogram(EffectID effect, Tool tool) {
 	if (ImGui::SliderFloat(id, &average, 0.0f, 1.0f, text)) {
 		// Change the average effect level to the new average
 		float deltaAverage = average - oldAverage;
-		for (int i = 0; i < BANK_LEN; i++) {
+		// A drag is one undo step from mouse down to release
+		strokeBegin();
+		parallelFor(0, BANK_LEN, [&](int i) {
 			if (0.0 < average && average < 1.0) {
 				currentBank.waves[i].effects[effect] = clampf(currentBank.waves[i].effects[effect] + deltaAverage, 0.0, 1.0);
 			}
@@ -573,20 +756,21 @@ void effectHistogram(EffectID effect, Tool tool) {
 				currentBank.waves[i].effects[effect] = average;
 			}
 			currentBank.waves[i].updatePost();
-			historyPush();
-		}
+		});
+		historyPush();
 	}
 
 	if (renderHistogram(effectNames[effect], 120, value, BANK_LEN, NULL, 0, tool)) {
+		strokeBegin();
 		for (int i = 0; i < BANK_LEN; i++) {
 			if (currentBank.waves[i].effects[effect] != value[i]) {
 				// TODO This always selects the highest index. Select the index the mouse is hovering (requires renderHistogram() to return an int)
 				selectWave(i);
 				currentBank.waves[i].effects[effect] = value[i];
 				currentBank.waves[i].updatePost();
-				historyPush();
 			}
 		}
+		historyPush();
 	}
 }
 
@@ -602,57 +786,162 @@ void effectPage() {
 		}
 		ImGui::PopItemWidth();
 
+		// Oversampling is a setting rather than an edit, so it does not push history
+		int oversample = effectOversample;
+		ImGui::Text("Nonlinear Oversampling:");
+		ImGui::SameLine();
+		if (ImGui::RadioButton("Off", oversample == 1)) oversample = 1;
+		ImGui::SameLine();
+		if (ImGui::RadioButton("4x", oversample == 4)) oversample = 4;
+		ImGui::SameLine();
+		if (ImGui::RadioButton("8x", oversample == 8)) oversample = 8;
+		if (oversample != effectOversample) {
+			effectOversample = oversample;
+			parallelFor(0, BANK_LEN, [&](int i) {
+				currentBank.waves[i].updatePost();
+			});
+		}
+
 		if (ImGui::Button("Cycle All")) {
+			historyBegin();
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].cycle = true;
 				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			historyCommit();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Cycle None")) {
+			historyBegin();
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].cycle = false;
 				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			historyCommit();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Normalize All")) {
+			historyBegin();
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].normalize = true;
 				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			historyCommit();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Normalize None")) {
+			historyBegin();
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].normalize = false;
 				currentBank.waves[i].updatePost();
-				historyPush();
 			}
+			historyCommit();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Randomize")) {
+			historyBegin();
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].randomizeEffects();
-				historyPush();
 			}
+			historyCommit();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Reset")) {
+			historyBegin();
 			for (int i = 0; i < BANK_LEN; i++) {
 				currentBank.waves[i].clearEffects();
-				historyPush();
 			}
+			historyCommit();
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Bake")) {
+			std::shared_ptr<Bank> baked = std::make_shared<Bank>(currentBank);
+			std::vector<uint32_t> source(BANK_LEN);
 			for (int i = 0; i < BANK_LEN; i++) {
-				currentBank.waves[i].bakeEffects();
+				source[i] = currentBank.waves[i].version;
+			}
+			jobsSubmit("Baking effects", [=](Job *job) {
+				for (int i = 0; i < BANK_LEN; i++) {
+					if (job->cancelled)
+						return;
+					baked->waves[i].bakeEffects();
+					job->progress = (float) (i + 1) / BANK_LEN;
+				}
+			}, [=]() {
+				// Waves edited while baking keep their edits
+				for (int i = 0; i < BANK_LEN; i++) {
+					if (currentBank.waves[i].version == source[i])
+						currentBank.waves[i] = baked->waves[i];
+				}
 				historyPush();
+			})->replacesBank = true;
+		}
+	}
+	ImGui::EndChild();
+}
+
+
+void harmonicsPage() {
+	// Harmonic magnitudes of each wave, and the wave versions they were read from
+	static float matrix[BANK_LEN * WAVE_LEN / 2];
+	static uint32_t versions[BANK_LEN] = {};
+	static bool keyframes[BANK_LEN] = {};
+	static int generation = 0;
+	// Pick up edits from other pages and undo
+	for (int j = 0; j < BANK_LEN; j++) {
+		Wave *wave = &currentBank.waves[j];
+		if (versions[j] != wave->version) {
+			memcpy(&matrix[j * WAVE_LEN / 2], wave->harmonics, sizeof(float) * WAVE_LEN / 2);
+			versions[j] = wave->version;
+		}
+	}
+	// The keyframes marked waves of a bank which has since been replaced
+	if (generation != bankGeneration) {
+		memset(keyframes, 0, sizeof(keyframes));
+		generation = bankGeneration;
+	}
+
+	ImGui::BeginChild("Harmonic Editor", ImVec2(0, 0), true); {
+		static Tool tool = PENCIL_TOOL;
+		renderToolSelector(&tool);
+
+		ImGui::PushItemWidth(-1);
+		static float brushValue = 0.5;
+		static float brushSize = 1.0;
+		ImGui::SliderFloat("##brushValue", &brushValue, 0.0, 1.0, "Magnitude: %.3f");
+		ImGui::SliderFloat("##brushSize", &brushSize, 0.0, 8.0, "Brush Size: %.1f");
+
+		bool changed[BANK_LEN] = {};
+		int selected = selectedId;
+		// A stroke is one undo step from mouse down to release, rather than a history push every painted frame
+		if (renderHarmonicMatrix("HarmonicMatrix", 400.0, matrix, changed, keyframes, &selected, brushValue, brushSize, tool))
+			strokeBegin();
+		if (selected != selectedId)
+			selectWave(selected);
+
+		if (ImGui::Button(keyframes[selectedId] ? "Remove Keyframe" : "Add Keyframe"))
+			keyframes[selectedId] = !keyframes[selectedId];
+		ImGui::SameLine();
+		if (ImGui::Button("Clear Keyframes"))
+			memset(keyframes, 0, sizeof(keyframes));
+		ImGui::SameLine();
+		if (ImGui::Button("Interpolate Between Keyframes"))
+			interpolateKeyframes(matrix, keyframes, changed);
+		ImGui::PopItemWidth();
+
+		// Commit every wave changed this frame in one batch
+		bool any = false;
+		for (int j = 0; j < BANK_LEN; j++) {
+			any = any || changed[j];
+		}
+		if (any) {
+			currentBank.setHarmonics(matrix, changed);
+			for (int j = 0; j < BANK_LEN; j++) {
+				if (changed[j])
+					versions[j] = currentBank.waves[j].version;
 			}
+			// Deferred to strokeEnd() while painting
+			historyPush();
 		}
 	}
 	ImGui::EndChild();
@@ -686,6 +975,29 @@ void waterfallPage() {
 }
 
 
+/** One line describing the background jobs, with a button to cancel them */
+static void renderJobStatus() {
+	const std::vector<std::shared_ptr<Job>> &jobs = jobsPending();
+	if (jobs.empty())
+		return;
+	// The first unfinished job is the one running
+	const Job *job = jobs.front().get();
+	for (const std::shared_ptr<Job> &j : jobs) {
+		if (!j->finished) {
+			job = j.get();
+			break;
+		}
+	}
+	if (ImGui::Button("Cancel"))
+		jobsCancelAll();
+	ImGui::SameLine();
+	if (jobs.size() > 1)
+		ImGui::Text("%s... %.0f%% (%d more queued)", job->name.c_str(), job->progress * 100.0, (int) jobs.size() - 1);
+	else
+		ImGui::Text("%s... %.0f%%", job->name.c_str(), job->progress * 100.0);
+}
+
+
 void renderMain() {
 	ImGui::SetNextWindowPos(ImVec2(0, 0));
 	ImGui::SetNextWindowSize(ImVec2((int)ImGui::GetIO().DisplaySize.x, (int)ImGui::GetIO().DisplaySize.y));
@@ -695,6 +1007,7 @@ void renderMain() {
 		// Menu bar
 		renderMenu();
 		renderPreview();
+		renderJobStatus();
 		// Tab bar
 		{
 			static const char *tabLabels[NUM_PAGES] = {
@@ -702,6 +1015,8 @@ void renderMain() {
 				"Effect Editor",
 				"Waterfall View",
 				"Import",
+				"Generator",
+				"Harmonics",
 			};
 			static int hoveredTab = 0;
 			ImGui::TabLabels(NUM_PAGES, tabLabels, (int*)&currentPage, NULL, false, &hoveredTab);
@@ -716,8 +1031,12 @@ void renderMain() {
 		case EFFECT_PAGE: effectPage(); break;
 		case WATERFALL_PAGE: waterfallPage(); break;
 		case IMPORT_PAGE: importPage(); break;
+		case GENERATOR_PAGE: generatorPage(); break;
+		case HARMONICS_PAGE: harmonicsPage(); break;
 		default: break;
 		}
+		if (!ImGui::IsMouseDown(0) || currentPage != strokePage)
+			strokeEnd();
 	}
 	ImGui::End();
 
@@ -864,6 +1183,10 @@ void uiInit() {
 		FILE *f = fopen("ui.dat", "rb");
 		if (f) {
 			fread(&styleId, sizeof(styleId), 1, f);
+			// Added later, so older files end before it
+			int oversample = 1;
+			if (fread(&oversample, sizeof(oversample), 1, f) == 1 && (oversample == 4 || oversample == 8))
+				effectOversample = oversample;
 			fclose(f);
 		}
 	}
@@ -878,6 +1201,8 @@ void uiDestroy() {
 		FILE *f = fopen("ui.dat", "wb");
 		if (f) {
 			fwrite(&styleId, sizeof(styleId), 1, f);
+			int oversample = effectOversample;
+			fwrite(&oversample, sizeof(oversample), 1, f);
 			fclose(f);
 		}
 	}
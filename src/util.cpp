@@ -26,7 +26,39 @@ void openBrowser(const char *url) {
 }
 
 
-float *loadAudio(const char *filename, int *length) {
+/** Splits interleaved frames into the planes, in one pass over `in`
+The common channel counts get their own loops so the compiler can vectorize the strided loads.
+*/
+void deinterleave(const float *in, int frames, int channels, float *planes, int planeLen) {
+	switch (channels) {
+		case 1: {
+			memcpy(planes, in, sizeof(float) * frames);
+		} break;
+		case 2: {
+			float *l = planes;
+			float *r = planes + planeLen;
+			for (int i = 0; i < frames; i++) {
+				l[i] = in[2 * i];
+				r[i] = in[2 * i + 1];
+			}
+		} break;
+		default: {
+			for (int i = 0; i < frames; i++) {
+				for (int c = 0; c < channels; c++) {
+					planes[c * planeLen + i] = in[i * channels + c];
+				}
+			}
+		} break;
+	}
+}
+
+
+float *loadAudioPlanar(const char *filename, int *length, int *channels) {
+	// Uncompressed WAV files skip libsndfile's buffering
+	float *mapped = loadWAVMapped(filename, length, channels);
+	if (mapped)
+		return mapped;
+
 	SF_INFO info;
 	SNDFILE *sf = sf_open(filename, SFM_READ, &info);
 	if (!sf)
@@ -34,27 +66,61 @@ float *loadAudio(const char *filename, int *length) {
 
 	// Get length of audio
 	int len = sf_seek(sf, 0, SEEK_END);
-	if (len <= 0)
+	if (len <= 0 || info.channels <= 0) {
+		sf_close(sf);
 		return NULL;
+	}
 	sf_seek(sf, 0, SEEK_SET);
-	float *samples = new float[len];
+	float *samples = new float[len * info.channels]();
 
+	ArenaScope scope;
+	const int bufferLen = 1<<12;
+	float *buffer = arenaArray<float>(bufferLen * info.channels);
 	int pos = 0;
 	while (pos < len) {
-		const int bufferLen = 1<<12;
-		float buffer[bufferLen * info.channels];
-		int frames = sf_readf_float(sf, buffer, bufferLen);
-		for (int i = 0; i < frames; i++) {
-			float sample = 0.0;
-			for (int c = 0; c < info.channels; c++) {
-				sample += buffer[i * info.channels + c];
-			}
-			samples[pos] = sample / info.channels;
-			pos++;
-		}
+		int frames = sf_readf_float(sf, buffer, mini(bufferLen, len - pos));
+		if (frames <= 0)
+			break;
+		deinterleave(buffer, frames, info.channels, samples + pos, len);
+		pos += frames;
 	}
 
 	sf_close(sf);
+	if (length)
+		*length = len;
+	if (channels)
+		*channels = info.channels;
+	return samples;
+}
+
+
+float *loadAudio(const char *filename, int *length) {
+	int len;
+	int channels;
+	float *planes = loadAudioPlanar(filename, &len, &channels);
+	if (!planes)
+		return NULL;
+	if (channels == 1) {
+		if (length)
+			*length = len;
+		return planes;
+	}
+
+	// Average the channels to mono, one plane at a time
+	float *samples = new float[len];
+	memcpy(samples, planes, sizeof(float) * len);
+	for (int c = 1; c < channels; c++) {
+		const float *plane = planes + c * len;
+		for (int i = 0; i < len; i++) {
+			samples[i] += plane[i];
+		}
+	}
+	float scale = 1.0 / channels;
+	for (int i = 0; i < len; i++) {
+		samples[i] *= scale;
+	}
+	delete[] planes;
+
 	if (length)
 		*length = len;
 	return samples;
@@ -1,11 +1,36 @@
 #include "WaveEdit.hpp"
 #include <string.h>
 #include <sndfile.h>
+#include <atomic>
 
 
 static Wave clipboardWave = {};
 bool clipboardActive = false;
 
+static std::atomic<uint32_t> versionCounter(0);
+static const int waveListenersMax = 8;
+static WaveListener waveListeners[waveListenersMax];
+static int waveListenersLen = 0;
+
+/** sin(2 pi i / LEN) */
+template <int LEN>
+struct SineTable {
+	float values[LEN];
+
+	SineTable() {
+		for (int i = 0; i < LEN; i++) {
+			values[i] = sin(2 * M_PI * i / LEN);
+		}
+	}
+};
+
+/** Built on first use */
+template <int LEN>
+static const float *sineTable() {
+	static const SineTable<LEN> table;
+	return table.values;
+}
+
 
 const char *effectNames[EFFECTS_LEN] {
 	"Pre-Gain",
@@ -23,34 +48,96 @@ const char *effectNames[EFFECTS_LEN] {
 };
 
 
-void Wave::clear() {
-	memset(this, 0, sizeof(Wave));
+std::atomic<int> effectOversample(1);
+
+
+/** Chebyshev waveshaping, sample & hold and quantization, on a wave of LEN samples at OVERSAMPLE times the original rate */
+template <int LEN, int OVERSAMPLE>
+static void applyNonlinear(float *x, const float *effects) {
+	// Chebyshev waveshaping
+	if (effects[CHEBYSHEV] > 0.0) {
+		float n = powf(50.0, effects[CHEBYSHEV]);
+		// Apply a distant variant of the Chebyshev polynomial of the first kind
+		effectKernels()->chebyshev(x, LEN, n);
+	}
+
+	// Sample & Hold
+	if (effects[SAMPLE_AND_HOLD] > 0.0) {
+		float frameskip = powf(LEN / OVERSAMPLE / 2.0, clampf(effects[SAMPLE_AND_HOLD], 0.0, 1.0));
+		effectKernels()->sampleAndHold(x, LEN, frameskip * OVERSAMPLE);
+	}
+
+	// Quantization
+	if (effects[QUANTIZATION] > 1e-3) {
+		float levels = powf(clampf(effects[QUANTIZATION], 0.0, 1.0), -1.5);
+		effectKernels()->quantize(x, LEN, levels);
+	}
 }
 
-void Wave::updatePost() {
-	float out[WAVE_LEN];
-	memcpy(out, samples, sizeof(float) * WAVE_LEN);
+
+/** Runs the nonlinear effects and the hard clip at OVERSAMPLE times the rate, so their harmonics above Nyquist are filtered instead of folded back
+Transforms longer than 2048 are not instantiated, so those waves are processed at the original rate.
+*/
+template <int LEN, int OVERSAMPLE, bool ENABLED = (LEN * OVERSAMPLE <= 2048)>
+struct Oversampler {
+	static void nonlinear(float *x, const float *effects) {
+		float up[LEN * OVERSAMPLE];
+		cyclicOversample<LEN, OVERSAMPLE>(x, up);
+		applyNonlinear<LEN * OVERSAMPLE, OVERSAMPLE>(up, effects);
+		cyclicDownsample<LEN, OVERSAMPLE>(up, x);
+	}
+
+	static void clip(float *x) {
+		float up[LEN * OVERSAMPLE];
+		cyclicOversample<LEN, OVERSAMPLE>(x, up);
+		effectKernels()->clip(up, LEN * OVERSAMPLE);
+		cyclicDownsample<LEN, OVERSAMPLE>(up, x);
+		// Band-limiting the clipped wave rings slightly past the rails
+		effectKernels()->clip(x, LEN);
+	}
+};
+
+template <int LEN, int OVERSAMPLE>
+struct Oversampler<LEN, OVERSAMPLE, false> {
+	static void nonlinear(float *x, const float *effects) {
+		applyNonlinear<LEN, 1>(x, effects);
+	}
+
+	static void clip(float *x) {
+		effectKernels()->clip(x, LEN);
+	}
+};
+
+
+template <int LEN>
+void applyEffects(const float *in, float *out, const float *effects, bool cycle, bool normalize) {
+	// Read once, since the UI thread can change it while workers are running the chain
+	int oversample = effectOversample;
+	memcpy(out, in, sizeof(float) * LEN);
 
 	// Pre-gain
 	if (effects[PRE_GAIN]) {
 		float gain = powf(20.0, effects[PRE_GAIN]);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] *= gain;
-		}
+		effectKernels()->gain(out, LEN, gain);
 	}
 
 	// Temporal and Harmonic Shift
 	if (effects[PHASE_SHIFT] > 0.0 || effects[HARMONIC_SHIFT] > 0.0) {
 		// Shift Fourier phase proportionally
-		float tmp[WAVE_LEN];
-		RFFT(out, tmp, WAVE_LEN);
-		for (int k = 0; k < WAVE_LEN / 2; k++) {
-			float phase = clampf(effects[HARMONIC_SHIFT], 0.0, 1.0) + clampf(effects[PHASE_SHIFT], 0.0, 1.0) * k;
-			float br = cosf(2 * M_PI * phase);
-			float bi = -sinf(2 * M_PI * phase);
+		float tmp[LEN];
+		RFFT<LEN>(out, tmp);
+		// Rotate bin k by e^(-2 pi i (harmonicShift + phaseShift * k)), stepping by e^(-2 pi i phaseShift) each bin
+		float harmonicShift = clampf(effects[HARMONIC_SHIFT], 0.0, 1.0);
+		float phaseShift = clampf(effects[PHASE_SHIFT], 0.0, 1.0);
+		float br = cosf(2 * M_PI * harmonicShift);
+		float bi = -sinf(2 * M_PI * harmonicShift);
+		float sr = cosf(2 * M_PI * phaseShift);
+		float si = -sinf(2 * M_PI * phaseShift);
+		for (int k = 0; k < LEN / 2; k++) {
 			cmultf(&tmp[2 * k], &tmp[2 * k + 1], tmp[2 * k], tmp[2 * k + 1], br, bi);
+			cmultf(&br, &bi, br, bi, sr, si);
 		}
-		IRFFT(tmp, out, WAVE_LEN);
+		IRFFT<LEN>(tmp, out);
 	}
 
 	// Comb filter
@@ -58,69 +145,53 @@ void Wave::updatePost() {
 		const float base = 0.75;
 		const int taps = 40;
 
+		// Exponentially decreasing tap amplitudes
+		float amplitudes[taps];
+		// Normalize by sum of geometric series
+		amplitudes[0] = 1.0 - base;
+		for (int j = 1; j < taps; j++) {
+			amplitudes[j] = amplitudes[j - 1] * base;
+		}
+
 		// Build the kernel in Fourier space
-		// Place taps at positions `comb * j`, with exponentially decreasing amplitude
-		float kernel[WAVE_LEN] = {};
-		for (int k = 0; k < WAVE_LEN / 2; k++) {
+		// Place taps at positions `comb * j`, rotating by e^(-2 pi i k comb) per tap
+		float kernel[LEN] = {};
+		for (int k = 0; k < LEN / 2; k++) {
+			float sr = cosf(2.0 * M_PI * k * effects[COMB]);
+			float si = -sinf(2.0 * M_PI * k * effects[COMB]);
+			float zr = 1.0;
+			float zi = 0.0;
 			for (int j = 0; j < taps; j++) {
-				float amplitude = powf(base, j);
-				// Normalize by sum of geometric series
-				amplitude *= (1.0 - base);
-				float phase = -2.0 * M_PI * k * effects[COMB] * j;
-				kernel[2 * k] += amplitude * cosf(phase);
-				kernel[2 * k + 1] += amplitude * sinf(phase);
+				kernel[2 * k] += amplitudes[j] * zr;
+				kernel[2 * k + 1] += amplitudes[j] * zi;
+				cmultf(&zr, &zi, zr, zi, sr, si);
 			}
 		}
 
 		// Convolve FFT of input with kernel
-		float fft[WAVE_LEN];
-		RFFT(out, fft, WAVE_LEN);
-		for (int k = 0; k < WAVE_LEN / 2; k++) {
+		float fft[LEN];
+		RFFT<LEN>(out, fft);
+		for (int k = 0; k < LEN / 2; k++) {
 			cmultf(&fft[2 * k], &fft[2 * k + 1], fft[2 * k], fft[2 * k + 1], kernel[2 * k], kernel[2 * k + 1]);
 		}
-		IRFFT(fft, out, WAVE_LEN);
+		IRFFT<LEN>(fft, out);
 	}
 
 	// Ring modulation
 	if (effects[RING] > 0.0) {
-		float ring = ceilf(powf(effects[RING], 2) * (WAVE_LEN / 2 - 2));
-		for (int i = 0; i < WAVE_LEN; i++) {
-			float phase = (float)i / WAVE_LEN * ring;
-			out[i] *= sinf(2 * M_PI * phase);
-		}
-	}
-
-	// Chebyshev waveshaping
-	if (effects[CHEBYSHEV] > 0.0) {
-		float n = powf(50.0, effects[CHEBYSHEV]);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			// Apply a distant variant of the Chebyshev polynomial of the first kind
-			if (-1.0 <= out[i] && out[i] <= 1.0)
-				out[i] = sinf(n * asinf(out[i]));
-			else
-				out[i] = sinf(n * asinf(1.0 / out[i]));
+		int ring = ceilf(powf(effects[RING], 2) * (LEN / 2 - 2));
+		const float *table = sineTable<LEN>();
+		for (int i = 0; i < LEN; i++) {
+			out[i] *= table[(i * ring) % LEN];
 		}
 	}
 
-	// Sample & Hold
-	if (effects[SAMPLE_AND_HOLD] > 0.0) {
-		float frameskip = powf(WAVE_LEN / 2.0, clampf(effects[SAMPLE_AND_HOLD], 0.0, 1.0));
-		float tmp[WAVE_LEN + 1];
-		memcpy(tmp, out, sizeof(float) * WAVE_LEN);
-		tmp[WAVE_LEN] = tmp[0];
-
-		// Dumb linear interpolation S&H
-		for (int i = 0; i < WAVE_LEN; i++) {
-			float index = roundf(i / frameskip) * frameskip;
-			out[i] = linterpf(tmp, clampf(index, 0.0, WAVE_LEN - 1));
-		}
-	}
-
-	// Quantization
-	if (effects[QUANTIZATION] > 1e-3) {
-		float levels = powf(clampf(effects[QUANTIZATION], 0.0, 1.0), -1.5);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] = roundf(out[i] * levels) / levels;
+	// Nonlinear effects
+	if (effects[CHEBYSHEV] > 0.0 || effects[SAMPLE_AND_HOLD] > 0.0 || effects[QUANTIZATION] > 1e-3) {
+		switch (oversample) {
+			case 4: Oversampler<LEN, 4>::nonlinear(out, effects); break;
+			case 8: Oversampler<LEN, 8>::nonlinear(out, effects); break;
+			default: applyNonlinear<LEN, 1>(out, effects); break;
 		}
 	}
 
@@ -129,7 +200,7 @@ void Wave::updatePost() {
 		float slew = powf(0.001, effects[SLEW]);
 
 		float y = out[0];
-		for (int i = 1; i < WAVE_LEN; i++) {
+		for (int i = 1; i < LEN; i++) {
 			float dxdt = out[i] - y;
 			float dydt = clampf(dxdt, -slew, slew);
 			y += dydt;
@@ -140,76 +211,91 @@ void Wave::updatePost() {
 	// Brick-wall lowpass / highpass filter
 	// TODO Maybe change this into a more musical filter
 	if (effects[LOWPASS] > 0.0 || effects[HIGHPASS]) {
-		float fft[WAVE_LEN];
-		RFFT(out, fft, WAVE_LEN);
+		float fft[LEN];
+		RFFT<LEN>(out, fft);
 		float lowpass = 1.0 - effects[LOWPASS];
 		float highpass = effects[HIGHPASS];
-		for (int i = 1; i < WAVE_LEN / 2; i++) {
-			float v = clampf(WAVE_LEN / 2 * lowpass - i, 0.0, 1.0) * clampf(-WAVE_LEN / 2 * highpass + i, 0.0, 1.0);
+		for (int i = 1; i < LEN / 2; i++) {
+			float v = clampf(LEN / 2 * lowpass - i, 0.0, 1.0) * clampf(-LEN / 2 * highpass + i, 0.0, 1.0);
 			fft[2 * i] *= v;
 			fft[2 * i + 1] *= v;
 		}
-		IRFFT(fft, out, WAVE_LEN);
+		IRFFT<LEN>(fft, out);
 	}
 
 	// TODO Consider removing because Normalize does this for you
 	// Post gain
 	if (effects[POST_GAIN]) {
 		float gain = powf(20.0, effects[POST_GAIN]);
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] *= gain;
-		}
+		effectKernels()->gain(out, LEN, gain);
 	}
 
 	// Cycle
 	if (cycle) {
-		float start = out[0];
-		float end = out[WAVE_LEN - 1] / (WAVE_LEN - 1) * WAVE_LEN;
-
-		for (int i = 0; i < WAVE_LEN; i++) {
-			out[i] -= (end - start) * (i - WAVE_LEN / 2) / WAVE_LEN;
-		}
+		effectKernels()->cycle(out, LEN);
 	}
 
 	// Normalize
 	if (normalize) {
-		float max = -INFINITY;
-		float min = INFINITY;
-		for (int i = 0; i < WAVE_LEN; i++) {
-			if (out[i] > max) max = out[i];
-			if (out[i] < min) min = out[i];
-		}
-
-		if (max - min >= 1e-6) {
-			for (int i = 0; i < WAVE_LEN; i++) {
-				out[i] = rescalef(out[i], min, max, -1.0, 1.0);
-			}
-		}
-		else {
-			memset(out, 0, sizeof(float) * WAVE_LEN);
-		}
+		effectKernels()->normalize(out, LEN);
 	}
 
 	// Hard clip :(
-	for (int i = 0; i < WAVE_LEN; i++) {
-		out[i] = clampf(out[i], -1.0, 1.0);
+	// A wave within the rails passes through unchanged, so it skips the resampling, which would also drop its Nyquist harmonic
+	float peak = 0.f;
+	for (int i = 0; i < LEN; i++) {
+		peak = fmaxf(peak, fabsf(out[i]));
+	}
+	switch (peak > 1.f ? oversample : 1) {
+		case 4: Oversampler<LEN, 4>::clip(out); break;
+		case 8: Oversampler<LEN, 8>::clip(out); break;
+		default: effectKernels()->clip(out, LEN); break;
 	}
+}
+
+template void applyEffects<128>(const float *in, float *out, const float *effects, bool cycle, bool normalize);
+template void applyEffects<256>(const float *in, float *out, const float *effects, bool cycle, bool normalize);
+template void applyEffects<2048>(const float *in, float *out, const float *effects, bool cycle, bool normalize);
+
+
+void waveSubscribe(WaveListener listener) {
+	assert(waveListenersLen < waveListenersMax);
+	waveListeners[waveListenersLen++] = listener;
+}
+
+
+void Wave::clear() {
+	memset(this, 0, sizeof(Wave));
+	bump();
+}
+
+void Wave::bump() {
+	version = ++versionCounter;
+	for (int i = 0; i < waveListenersLen; i++) {
+		waveListeners[i](this);
+	}
+}
+
+void Wave::updatePost() {
+	float out[WAVE_LEN];
+	applyEffects<WAVE_LEN>(samples, out, effects, cycle, normalize);
 
 	// TODO Fix possible race condition with audio thread here
 	// Or not, because the race condition would only just replace samples as they are being read, which just gives a click sound.
 	memcpy(postSamples, out, sizeof(float)*WAVE_LEN);
 
 	// Convert wave to spectrum
-	RFFT(postSamples, postSpectrum, WAVE_LEN);
+	RFFT<WAVE_LEN>(postSamples, postSpectrum);
 	// Convert spectrum to harmonics
 	for (int i = 0; i < WAVE_LEN / 2; i++) {
 		postHarmonics[i] = hypotf(postSpectrum[2 * i], postSpectrum[2 * i + 1]) * 2.0;
 	}
+	bump();
 }
 
 void Wave::commitSamples() {
 	// Convert wave to spectrum
-	RFFT(samples, spectrum, WAVE_LEN);
+	RFFT<WAVE_LEN>(samples, spectrum);
 	// Convert spectrum to harmonics
 	for (int i = 0; i < WAVE_LEN / 2; i++) {
 		harmonics[i] = hypotf(spectrum[2 * i], spectrum[2 * i + 1]) * 2.0;
@@ -247,7 +333,7 @@ void Wave::commitHarmonics() {
 		}
 	}
 	// Convert spectrum to wave
-	IRFFT(spectrum, samples, WAVE_LEN);
+	IRFFT<WAVE_LEN>(spectrum, samples);
 	updatePost();
 }
 
@@ -271,17 +357,9 @@ void Wave::randomizeEffects() {
 }
 
 void Wave::saveWAV(const char *filename) {
-	SF_INFO info;
-	info.samplerate = 44100;
-	info.channels = 1;
-	info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16 | SF_ENDIAN_LITTLE;
-	SNDFILE *sf = sf_open(filename, SFM_WRITE, &info);
-	if (!sf)
-		return;
-
-	sf_write_float(sf, postSamples, WAVE_LEN);
-
-	sf_close(sf);
+	std::vector<uint8_t> data;
+	encodeWAV(postSamples, WAVE_LEN, 44100, EXPORT_PCM16, data);
+	writeFile(filename, data);
 }
 
 void Wave::loadWAV(const char *filename) {
@@ -306,5 +384,6 @@ void Wave::clipboardCopy() {
 void Wave::clipboardPaste() {
 	if (clipboardActive) {
 		memcpy(this, &clipboardWave, sizeof(*this));
+		bump();
 	}
 }
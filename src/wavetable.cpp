@@ -0,0 +1,124 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+
+
+const WavetableGeometry wavetableGeometries[] = {
+	{"MicroMonsta (33 x 128)", WAVE_LEN, BANK_LEN},
+	{"64 x 256", 256, 64},
+	{"256 x 256", 256, 256},
+	{"64 x 2048", 2048, 64},
+	{"256 x 2048", 2048, 256},
+};
+
+const int wavetableGeometriesLen = sizeof(wavetableGeometries) / sizeof(wavetableGeometries[0]);
+
+
+/** Resamples one WAVE_LEN cycle to `outLen`, using the fixed-length templates for common ratios */
+static void upsampleWave(const float *in, float *out, int outLen) {
+	switch (outLen) {
+		case WAVE_LEN: memcpy(out, in, sizeof(float) * WAVE_LEN); break;
+		case WAVE_LEN * 2: cyclicOversample<WAVE_LEN, 2>(in, out); break;
+		case WAVE_LEN * 4: cyclicOversample<WAVE_LEN, 4>(in, out); break;
+		case WAVE_LEN * 8: cyclicOversample<WAVE_LEN, 8>(in, out); break;
+		case WAVE_LEN * 16: cyclicOversample<WAVE_LEN, 16>(in, out); break;
+		default: cyclicResample(in, WAVE_LEN, out, outLen); break;
+	}
+}
+
+
+void renderWavetableFrame(BankPlanes *planes, int j, int bankLen, float *out, int waveLen) {
+	// Spread the frames evenly from the first wave to the last
+	float z = (bankLen > 1) ? (float) j * (BANK_LEN - 1) / (bankLen - 1) : 0.0;
+	float wave[WAVE_LEN];
+	planes->morphZ(z, wave);
+	upsampleWave(wave, out, waveLen);
+}
+
+
+Wavetable::~Wavetable() {
+	alignedFree(samples);
+}
+
+
+void Wavetable::resize(int waveLen, int bankLen) {
+	alignedFree(samples);
+	this->waveLen = waveLen;
+	this->bankLen = bankLen;
+	samples = (float*) alignedMalloc(sizeof(float) * waveLen * bankLen);
+	memset(samples, 0, sizeof(float) * waveLen * bankLen);
+}
+
+
+void Wavetable::renderBank(Bank *bank) {
+	// Fast path for the native layout
+	if (waveLen == WAVE_LEN && bankLen == BANK_LEN) {
+		bank->getPostSamples(samples);
+		return;
+	}
+
+	BankPlanes *planes = new BankPlanes();
+	planes->load(bank);
+	for (int j = 0; j < bankLen; j++) {
+		renderWavetableFrame(planes, j, bankLen, &samples[j * waveLen], waveLen);
+	}
+	delete planes;
+}
+
+
+void Wavetable::toBank(Bank *bank) {
+	if (waveLen == WAVE_LEN && bankLen == BANK_LEN) {
+		bank->setSamples(samples);
+		return;
+	}
+	if (bankLen <= 0)
+		return;
+
+	float *bankSamples = new float[BANK_LEN * WAVE_LEN];
+	float *frame = new float[waveLen];
+	for (int j = 0; j < BANK_LEN; j++) {
+		// Crossfade between the two nearest frames
+		float z = (float) j * (bankLen - 1) / (BANK_LEN - 1);
+		int zi = z;
+		float zf = z - zi;
+		const float *a = &samples[zi * waveLen];
+		const float *b = &samples[mini(zi + 1, bankLen - 1) * waveLen];
+		for (int i = 0; i < waveLen; i++) {
+			frame[i] = crossf(a[i], b[i], zf);
+		}
+		cyclicResample(frame, waveLen, &bankSamples[j * WAVE_LEN], WAVE_LEN);
+	}
+	bank->setSamples(bankSamples);
+	delete[] frame;
+	delete[] bankSamples;
+}
+
+
+void Wavetable::saveWAV(const char *filename) {
+	WavetableWriter writer;
+	if (!writer.open(filename, waveLen, EXPORT_PCM16, false))
+		return;
+	writer.write(samples, waveLen * bankLen);
+	writer.close();
+}
+
+
+bool Wavetable::loadWAV(const char *filename, int waveLen) {
+	alignedFree(samples);
+	samples = NULL;
+	this->waveLen = waveLen;
+	bankLen = 0;
+
+	int len;
+	float *audio = loadAudio(filename, &len);
+	if (!audio)
+		return false;
+	if (len < waveLen) {
+		delete[] audio;
+		return false;
+	}
+
+	resize(waveLen, len / waveLen);
+	memcpy(samples, audio, sizeof(float) * waveLen * bankLen);
+	delete[] audio;
+	return true;
+}
@@ -0,0 +1,229 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <algorithm>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+
+/** A read-only view of a whole file */
+struct MappedFile {
+	const uint8_t *data = NULL;
+	size_t size = 0;
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+
+	bool open(const char *filename);
+	void close();
+};
+
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const char *filename) {
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+	size = fileSize.QuadPart;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		close();
+		return false;
+	}
+	data = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	data = NULL;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+	size = 0;
+}
+
+#else
+
+bool MappedFile::open(const char *filename) {
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+	if (p == MAP_FAILED) {
+		size = 0;
+		return false;
+	}
+	// The file is read front to back exactly once
+	madvise(p, size, MADV_SEQUENTIAL);
+	data = (const uint8_t*) p;
+	return true;
+}
+
+void MappedFile::close() {
+	if (data)
+		munmap((void*) data, size);
+	data = NULL;
+	size = 0;
+}
+
+#endif
+
+
+static uint16_t get16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+
+/** The parts of the fmt chunk the reader needs */
+struct WAVFormat {
+	/** 1 for PCM, 3 for IEEE float */
+	int tag;
+	int channels;
+	int bits;
+	int blockAlign;
+};
+
+
+/** Finds the fmt and data chunks. Returns false if the file is not a WAV file this reader handles */
+static bool parseWAV(const MappedFile &file, WAVFormat *format, size_t *dataOffset, size_t *dataSize) {
+	if (file.size < 12 || memcmp(file.data, "RIFF", 4) != 0 || memcmp(file.data + 8, "WAVE", 4) != 0)
+		return false;
+
+	bool fmtFound = false;
+	size_t pos = 12;
+	while (pos + 8 <= file.size) {
+		const uint8_t *chunk = file.data + pos;
+		size_t chunkSize = get32(chunk + 4);
+		size_t bodySize = std::min(chunkSize, file.size - pos - 8);
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			if (bodySize < 16)
+				return false;
+			format->tag = get16(chunk + 8);
+			format->channels = get16(chunk + 10);
+			format->blockAlign = get16(chunk + 20);
+			format->bits = get16(chunk + 22);
+			// WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of the subformat GUID
+			if (format->tag == 0xfffe) {
+				if (bodySize < 40)
+					return false;
+				format->tag = get16(chunk + 32);
+			}
+			fmtFound = true;
+		}
+		else if (memcmp(chunk, "data", 4) == 0) {
+			if (!fmtFound)
+				return false;
+			*dataOffset = pos + 8;
+			// Streaming writers may leave the size at 0xffffffff, so read to the end of the file instead.
+			// A size of 0 is taken as written, which leaves the file to libsndfile since it has no frames.
+			*dataSize = (chunkSize == 0xffffffff) ? file.size - pos - 8 : bodySize;
+			return true;
+		}
+
+		// Chunks are word aligned
+		pos += 8 + chunkSize + (chunkSize % 2);
+	}
+	return false;
+}
+
+
+/** Converts `len` interleaved samples starting at `in` */
+static void convertSamples(const uint8_t *in, float *out, int len, const WAVFormat &format) {
+	if (format.tag == 3)
+		memcpy(out, in, sizeof(float) * len);
+	else if (format.bits == 16)
+		i16_to_f32((const int16_t*) in, out, len);
+	else if (format.bits == 24)
+		i24_to_f32(in, out, len);
+	else
+		i32_to_f32((const int32_t*) in, out, len);
+}
+
+
+float *loadWAVMapped(const char *filename, int *length, int *channels) {
+	MappedFile file;
+	if (!file.open(filename))
+		return NULL;
+
+	WAVFormat format = {};
+	size_t dataOffset;
+	size_t dataSize;
+	if (!parseWAV(file, &format, &dataOffset, &dataSize)) {
+		file.close();
+		return NULL;
+	}
+
+	// Everything else, including big-endian RIFX and 8-bit PCM, is left to libsndfile
+	bool supported = (format.tag == 1 && (format.bits == 16 || format.bits == 24 || format.bits == 32))
+		|| (format.tag == 3 && format.bits == 32);
+	int bytes = format.bits / 8;
+	supported = supported && format.channels > 0 && format.blockAlign == format.channels * bytes;
+	// Samples are read in place, so they must be aligned to their size
+	supported = supported && (bytes == 3 || dataOffset % bytes == 0);
+	int64_t frames = dataSize / maxi(format.blockAlign, 1);
+	supported = supported && frames > 0 && frames * format.channels <= INT32_MAX;
+	if (!supported) {
+		file.close();
+		return NULL;
+	}
+
+	int len = frames;
+	float *samples = new float[(int64_t) len * format.channels];
+	const uint8_t *data = file.data + dataOffset;
+	if (format.channels == 1) {
+		convertSamples(data, samples, len, format);
+	}
+	else {
+		// Convert a block of frames at a time while it is in cache, then split it into the planes
+		ArenaScope scope;
+		const int blockLen = 1<<12;
+		float *block = arenaArray<float>(blockLen * format.channels);
+		for (int pos = 0; pos < len; pos += blockLen) {
+			int blockFrames = mini(blockLen, len - pos);
+			convertSamples(data + (size_t) pos * format.blockAlign, block, blockFrames * format.channels, format);
+			deinterleave(block, blockFrames, format.channels, samples + pos, len);
+		}
+	}
+
+	file.close();
+	if (length)
+		*length = len;
+	if (channels)
+		*channels = format.channels;
+	return samples;
+}
@@ -6,6 +6,27 @@
 
 
 
+struct DisplayCurve {
+	/** Version of the wave the curve was computed from */
+	uint32_t version;
+	float curve[WAVE_LEN * DISPLAY_OVERSAMPLE];
+};
+
+/** Version 0 is a zeroed wave, which matches the zeroed curves */
+static DisplayCurve displayCurves[BANK_LEN];
+
+
+const float *getDisplayCurve(Bank *bank, int waveId) {
+	DisplayCurve *c = &displayCurves[waveId];
+	Wave *wave = &bank->waves[waveId];
+	if (c->version != wave->version) {
+		cyclicOversample<WAVE_LEN, DISPLAY_OVERSAMPLE>(wave->postSamples, c->curve);
+		c->version = wave->version;
+	}
+	return c->curve;
+}
+
+
 static void drawGrid(ImRect inner, int len) {
 	ImGuiWindow *window = ImGui::GetCurrentWindow();
 	// Compute number of points to skip, should be a power of 2
@@ -324,15 +345,15 @@ void renderBankGrid(const char *name, float height, int gridWidth, float *gridX,
 
 		// Draw lines
 		ImGui::PushClipRect(cellBox.Min, cellBox.Max, true);
-		ImVec2 lastPos;
-		for (int i = 0; i < WAVE_LEN; i++) {
-			float value = currentBank.waves[j].postSamples[i];
+		const float *curve = getDisplayCurve(&currentBank, j);
+		// Stop at the last original sample, which lands on the right edge
+		const int curveLen = (WAVE_LEN - 1) * DISPLAY_OVERSAMPLE + 1;
+		ImVec2 points[curveLen];
+		for (int i = 0; i < curveLen; i++) {
 			float margin = 3.0;
-			ImVec2 pos = ImVec2(rescalef(i, 0, WAVE_LEN - 1, cellBox.Min.x, cellBox.Max.x), rescalef(value, 1.0, -1.0, cellBox.Min.y + margin, cellBox.Max.y - margin));
-			if (i > 0)
-				window->DrawList->AddLine(lastPos, pos, ImGui::GetColorU32(ImGuiCol_PlotLines));
-			lastPos = pos;
+			points[i] = ImVec2(rescalef(i, 0, curveLen - 1, cellBox.Min.x, cellBox.Max.x), rescalef(curve[i], 1.0, -1.0, cellBox.Min.y + margin, cellBox.Max.y - margin));
 		}
+		window->DrawList->AddPolyline(points, curveLen, ImGui::GetColorU32(ImGuiCol_PlotLines), false, 1.0, true);
 
 		// Draw cell label
 		char label[64];
@@ -518,19 +539,41 @@ void renderWaterfall(const char *name, float height, float amplitude, float angl
 		window->DrawList->AddPolyline(points, WAVE_LEN, ImGui::GetColorU32(ImGuiCol_FrameBg), false, thickness, true);
 	}
 
+	// Spectral morph frames between waves
+	if (morphSpectral) {
+		for (int b = 0; b < BANK_LEN - 1; b++) {
+			for (int s = 1; s < LATTICE_STEPS; s++) {
+				float z = b + (float) s / LATTICE_STEPS;
+				float frame[WAVE_LEN];
+				if (!latticeMorphZ(z, frame))
+					continue;
+				ImVec2 points[WAVE_LEN];
+				for (int i = 0; i < WAVE_LEN; i++) {
+					ImVec2 a = ImVec2(rescalef(i, 0, WAVE_LEN-1, -1.0, 1.0), rescalef(z, 0, BANK_LEN-1, -1.0, 1.0));
+					a = ImRotate(a, cosf(theta), sinf(theta)) / M_SQRT2;
+					a.y += -amplitude * 0.3 * frame[i];
+					points[i] = ImVec2(rescalef(a.x, -1.0, 1.0, box.Min.x, box.Max.x), rescalef(a.y, 1.0, -1.0, box.Min.y, box.Max.y));
+				}
+				window->DrawList->AddPolyline(points, WAVE_LEN, ImGui::GetColorU32(ImGuiCol_PlotLines), false, 0.5, true);
+			}
+		}
+	}
+
 	// Post-effect plots
 	for (int b = 0; b < BANK_LEN; b++) {
-		ImVec2 points[WAVE_LEN];
-		for (int i = 0; i < WAVE_LEN; i++) {
-			float value = currentBank.waves[b].postSamples[i];
-			ImVec2 a = ImVec2(rescalef(i, 0, WAVE_LEN-1, -1.0, 1.0), rescalef(b, 0, BANK_LEN-1, -1.0, 1.0));
+		const float *curve = getDisplayCurve(&currentBank, b);
+		const int curveLen = (WAVE_LEN - 1) * DISPLAY_OVERSAMPLE + 1;
+		ImVec2 points[curveLen];
+		for (int i = 0; i < curveLen; i++) {
+			float value = curve[i];
+			ImVec2 a = ImVec2(rescalef(i, 0, curveLen - 1, -1.0, 1.0), rescalef(b, 0, BANK_LEN-1, -1.0, 1.0));
 			a = ImRotate(a, cosf(theta), sinf(theta)) / M_SQRT2;
 			a.y += -amplitude * 0.3 * value;
 			ImVec2 point = ImVec2(rescalef(a.x, -1.0, 1.0, box.Min.x, box.Max.x), rescalef(a.y, 1.0, -1.0, box.Min.y, box.Max.y));
 			points[i] = point;
 		}
 		float thickness = 1.0 + 4.0 * fmaxf(1.0 - fabsf(b - *activeZ), 0.0);
-		window->DrawList->AddPolyline(points, WAVE_LEN, ImGui::GetColorU32(ImGuiCol_PlotHistogram), false, thickness, true);
+		window->DrawList->AddPolyline(points, curveLen, ImGui::GetColorU32(ImGuiCol_PlotHistogram), false, thickness, true);
 	}
 
 	ImGui::PopClipRect();
@@ -607,3 +650,130 @@ float renderBankWave(const char *name, float height, const float *lines, int lin
 	return delta;
 }
 
+
+
+/** Color of a harmonic magnitude, from the frame background at 0 to the histogram color at 1 */
+static ImU32 magnitudeColor(float magnitude) {
+	const ImGuiStyle &style = ImGui::GetStyle();
+	ImVec4 a = style.Colors[ImGuiCol_FrameBg];
+	ImVec4 b = style.Colors[ImGuiCol_PlotHistogram];
+	// Most harmonics are quiet, so spread out the low end
+	float p = sqrtf(clampf(magnitude, 0.0, 1.0));
+	return ImGui::GetColorU32(ImVec4(crossf(a.x, b.x, p), crossf(a.y, b.y, p), crossf(a.z, b.z, p), 1.0));
+}
+
+/** Paints the cells around (`wave`, `harmonic`), in cell units */
+static void matrixBrush(float *matrix, bool *changed, float wave, float harmonic, float value, float size, enum Tool tool) {
+	const int rows = WAVE_LEN / 2;
+	// The pencil fills a disk, and the brush fades out over a wider one
+	float radius = (tool == BRUSH_TOOL) ? size + 1.0 : size + 0.5;
+	float sigma = size / 2.0 + 0.5;
+	int j0 = maxi(0, ceilf(wave - radius));
+	int j1 = mini(BANK_LEN - 1, floorf(wave + radius));
+	int i0 = maxi(0, ceilf(harmonic - radius));
+	int i1 = mini(rows - 1, floorf(harmonic + radius));
+	for (int j = j0; j <= j1; j++) {
+		for (int i = i0; i <= i1; i++) {
+			float d2 = (j - wave) * (j - wave) + (i - harmonic) * (i - harmonic);
+			if (d2 > radius * radius)
+				continue;
+			float *cell = &matrix[j * rows + i];
+			if (tool == BRUSH_TOOL)
+				*cell = crossf(*cell, value, 0.5 * expf(-d2 / (2.0 * sigma * sigma)));
+			else if (tool == ERASER_TOOL)
+				*cell = 0.0;
+			else
+				*cell = value;
+			changed[j] = true;
+		}
+	}
+}
+
+
+bool renderHarmonicMatrix(const char *name, float height, float *matrix, bool *changed, const bool *keyframes, int *selected, float brushValue, float brushSize, enum Tool tool) {
+	const int rows = WAVE_LEN / 2;
+	ImGuiContext &g = *GImGui;
+	ImGuiWindow *window = ImGui::GetCurrentWindow();
+	const ImGuiStyle &style = g.Style;
+	const ImGuiID id = window->GetID(name);
+
+	// Compute positions
+	ImVec2 size = ImVec2(ImGui::CalcItemWidth(), height);
+	ImRect box = ImRect(window->DC.CursorPos, window->DC.CursorPos + size);
+	ImRect inner = ImRect(box.Min + style.FramePadding, box.Max - style.FramePadding);
+	ImGui::ItemSize(box, style.FramePadding.y);
+	if (!ImGui::ItemAdd(box, NULL))
+		return false;
+
+	// Behavior
+	bool hovered = ImGui::IsHovered(box, id);
+	if (hovered) {
+		ImGui::SetHoveredID(id);
+		if (g.IO.MouseClicked[0]) {
+			ImGui::SetActiveID(id, window);
+			ImGui::FocusWindow(window);
+		}
+	}
+	if (g.ActiveId == id) {
+		if (!g.IO.MouseDown[0]) {
+			ImGui::ClearActiveID();
+		}
+	}
+
+	bool edited = false;
+	if (g.ActiveId == id && g.IO.MouseDown[0]) {
+		// Cell coordinates, with cell centers on integers
+		ImVec2 pos = g.IO.MousePos;
+		ImVec2 lastPos = g.IO.MouseClicked[0] ? pos : pos - g.IO.MouseDelta;
+		float wave = rescalef(pos.x, inner.Min.x, inner.Max.x, -0.5, BANK_LEN - 0.5);
+		float harmonic = rescalef(pos.y, inner.Max.y, inner.Min.y, -0.5, rows - 0.5);
+		float lastWave = rescalef(lastPos.x, inner.Min.x, inner.Max.x, -0.5, BANK_LEN - 0.5);
+		float lastHarmonic = rescalef(lastPos.y, inner.Max.y, inner.Min.y, -0.5, rows - 0.5);
+		if (selected)
+			*selected = clampi(roundf(wave), 0, BANK_LEN - 1);
+
+		if (tool == PENCIL_TOOL || tool == BRUSH_TOOL || tool == ERASER_TOOL) {
+			// Stamp along the stroke so fast drags leave no gaps
+			int steps = ceilf(fmaxf(fabsf(wave - lastWave), fabsf(harmonic - lastHarmonic)));
+			for (int s = 0; s <= steps; s++) {
+				float frac = (steps > 0) ? (float) s / steps : 1.0;
+				matrixBrush(matrix, changed, crossf(lastWave, wave, frac), crossf(lastHarmonic, harmonic, frac), brushValue, brushSize, tool);
+			}
+			edited = true;
+		}
+	}
+
+	// Draw frame
+	ImGui::RenderFrame(box.Min, box.Max, ImGui::GetColorU32(ImGuiCol_FrameBg), true, style.FrameRounding);
+
+	// Draw cells
+	ImGui::PushClipRect(box.Min, box.Max, true);
+	for (int j = 0; j < BANK_LEN; j++) {
+		float x0 = rescalef(j, 0, BANK_LEN, inner.Min.x, inner.Max.x);
+		float x1 = rescalef(j + 1, 0, BANK_LEN, inner.Min.x, inner.Max.x);
+		for (int i = 0; i < rows; i++) {
+			float magnitude = matrix[j * rows + i];
+			if (magnitude <= 0.0)
+				continue;
+			float y0 = rescalef(i + 1, 0, rows, inner.Max.y, inner.Min.y);
+			float y1 = rescalef(i, 0, rows, inner.Max.y, inner.Min.y);
+			window->DrawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), magnitudeColor(magnitude));
+		}
+		// Keyframe marker
+		if (keyframes && keyframes[j]) {
+			window->DrawList->AddRectFilled(ImVec2(x0, inner.Min.y), ImVec2(x1, inner.Min.y + 4.0), ImGui::GetColorU32(ImGuiCol_PlotLines));
+		}
+	}
+	// Selected wave
+	if (selected) {
+		float x0 = rescalef(*selected, 0, BANK_LEN, inner.Min.x, inner.Max.x);
+		float x1 = rescalef(*selected + 1, 0, BANK_LEN, inner.Min.x, inner.Max.x);
+		window->DrawList->AddLine(ImVec2(x0, inner.Min.y), ImVec2(x0, inner.Max.y), ImGui::GetColorU32(ImGuiCol_PlotLines));
+		window->DrawList->AddLine(ImVec2(x1, inner.Min.y), ImVec2(x1, inner.Max.y), ImGui::GetColorU32(ImGuiCol_PlotLines));
+	}
+	// Draw grid
+	drawGrid(inner, BANK_LEN);
+	ImGui::PopClipRect();
+
+	return edited;
+}
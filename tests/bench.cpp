@@ -0,0 +1,510 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <chrono>
+#include <sndfile.h>
+#include <map>
+
+
+// Throughput of the hot loops of the core, for comparing changes on the same machine
+// The kernels are also timed against the libm loops they replace, with their largest error.
+// Usage: bench [--baseline <file> | --write <file>] [tmpdir] [megabytes of the load benchmark, 0 to skip]
+// Fails if an optimized path is slower than the one it replaces, or with --baseline, if a timing regressed against one written by --write on the same machine.
+
+/** Returns the seconds per call of `f`, repeating it for at least 0.2 seconds */
+static double timeIt(std::function<void()> f) {
+	f();
+	auto start = std::chrono::steady_clock::now();
+	int64_t calls = 0;
+	double elapsed = 0.0;
+	while (elapsed < 0.2) {
+		for (int i = 0; i < 16; i++) {
+			f();
+		}
+		calls += 16;
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return elapsed / calls;
+}
+
+/** Defeats dead code elimination of the reference loops */
+static volatile float sink;
+
+/** A timing may be this much slower than the baseline before it counts as a regression, since timings are noisy */
+static const double regressionRatio = 1.25;
+
+/** Seconds per call of each recorded timing, in the order they ran */
+static std::vector<std::pair<std::string, double>> results;
+static int failures = 0;
+
+/** Records a timing for the baseline and returns it */
+static double record(const char *name, double t) {
+	results.push_back(std::make_pair(std::string(name), t));
+	return t;
+}
+
+/** Fails the run if an optimized path `t` is not faster than the path `ref` it replaces, within the noise */
+static void requireFaster(const char *name, double t, double ref) {
+	if (t > ref * regressionRatio) {
+		printf("  FAILED: %s is not faster than the path it replaces\n", name);
+		failures++;
+	}
+}
+
+/** Where the large file benchmark writes its file, and its size */
+static const char *tmpDir = ".";
+static int64_t loadMegabytes = 1024;
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static void benchKernels() {
+	const int len = 4096;
+	float *in = (float*) alignedMalloc(sizeof(float) * len);
+	float *x = (float*) alignedMalloc(sizeof(float) * len);
+	float *ref = (float*) alignedMalloc(sizeof(float) * len);
+	for (int i = 0; i < len; i++) {
+		in[i] = sinf(2 * M_PI * i / len * 3.f) * 1.2f;
+	}
+
+	// The selected kernels are the generic loops autovectorized for a wider instruction set, so the generic column shows what that gains
+	const EffectKernels *kernels = effectKernels();
+	const EffectKernels *generic = genericEffectKernels();
+	printf("Effect kernels, ns per sample\n");
+	printf("  %-12s %8s %8s %8s %10s\n", "", kernels->name, generic->name, "libm", "max error");
+
+	const float n = 20.f;
+	double tRef = timeIt([&]() {
+		for (int i = 0; i < len; i++) {
+			float v = (-1.f <= in[i] && in[i] <= 1.f) ? in[i] : 1.f / in[i];
+			ref[i] = sinf(n * asinf(v));
+		}
+		sink = ref[0];
+	});
+	double tGeneric = timeIt([&]() {
+		memcpy(x, in, sizeof(float) * len);
+		generic->chebyshev(x, len, n);
+	});
+	double t = record("kernel chebyshev", timeIt([&]() {
+		memcpy(x, in, sizeof(float) * len);
+		kernels->chebyshev(x, len, n);
+	}));
+	float error = 0.f;
+	for (int i = 0; i < len; i++) {
+		error = fmaxf(error, fabsf(x[i] - ref[i]));
+	}
+	printf("  %-12s %8.2f %8.2f %8.2f %10.2g\n", "chebyshev", t / len * 1e9, tGeneric / len * 1e9, tRef / len * 1e9, error);
+	requireFaster("chebyshev", t, fminf(tGeneric, tRef));
+
+	const float levels = 11.3f;
+	tRef = timeIt([&]() {
+		for (int i = 0; i < len; i++) {
+			ref[i] = roundf(in[i] * levels) / levels;
+		}
+		sink = ref[0];
+	});
+	tGeneric = timeIt([&]() {
+		memcpy(x, in, sizeof(float) * len);
+		generic->quantize(x, len, levels);
+	});
+	t = record("kernel quantize", timeIt([&]() {
+		memcpy(x, in, sizeof(float) * len);
+		kernels->quantize(x, len, levels);
+	}));
+	error = 0.f;
+	for (int i = 0; i < len; i++) {
+		error = fmaxf(error, fabsf(x[i] - ref[i]));
+	}
+	printf("  %-12s %8.2f %8.2f %8.2f %10.2g\n", "quantize", t / len * 1e9, tGeneric / len * 1e9, tRef / len * 1e9, error);
+	requireFaster("quantize", t, fminf(tGeneric, tRef));
+
+	// Kernels without a libm counterpart
+	struct Case {
+		const char *name;
+		std::function<void(const EffectKernels *k)> run;
+	};
+	const Case cases[] = {
+		{"sample&hold", [&](const EffectKernels *k) { k->sampleAndHold(x, len, 7.3f); }},
+		{"normalize", [&](const EffectKernels *k) { k->normalize(x, len); }},
+		{"clip", [&](const EffectKernels *k) { k->clip(x, len); }},
+	};
+	for (const Case &c : cases) {
+		tGeneric = timeIt([&]() {
+			memcpy(x, in, sizeof(float) * len);
+			c.run(generic);
+		});
+		t = record(stringf("kernel %s", c.name).c_str(), timeIt([&]() {
+			memcpy(x, in, sizeof(float) * len);
+			c.run(kernels);
+		}));
+		printf("  %-12s %8.2f %8.2f\n", c.name, t / len * 1e9, tGeneric / len * 1e9);
+		requireFaster(c.name, t, tGeneric);
+	}
+
+	alignedFree(in);
+	alignedFree(x);
+	alignedFree(ref);
+}
+
+
+static void benchConvert() {
+	const int len = 1 << 16;
+	float *f = new float[len];
+	int16_t *i16 = new int16_t[len];
+	uint8_t *i24 = new uint8_t[3 * len];
+	int32_t *i32 = new int32_t[len];
+	float *dither = new float[len];
+	for (int i = 0; i < len; i++) {
+		f[i] = sinf(i * 0.01f);
+	}
+	uint32_t seed = 1;
+	tpdfDither(dither, len, &seed);
+
+	printf("Sample conversion (%s), Msamples/s\n", convertKernels()->name);
+	printf("  %-20s %8.0f\n", "f32 to i16", len / record("convert f32 to i16", timeIt([&]() { f32_to_i16(f, i16, len); })) * 1e-6);
+	printf("  %-20s %8.0f\n", "f32 to i16, dither", len / record("convert f32 to i16, dither", timeIt([&]() { f32_to_i16(f, i16, len, dither); })) * 1e-6);
+	printf("  %-20s %8.0f\n", "f32 to i24", len / record("convert f32 to i24", timeIt([&]() { f32_to_i24(f, i24, len); })) * 1e-6);
+	printf("  %-20s %8.0f\n", "f32 to i32", len / record("convert f32 to i32", timeIt([&]() { f32_to_i32(f, i32, len); })) * 1e-6);
+	printf("  %-20s %8.0f\n", "i16 to f32", len / record("convert i16 to f32", timeIt([&]() { i16_to_f32(i16, f, len); })) * 1e-6);
+	printf("  %-20s %8.0f\n", "i24 to f32", len / record("convert i24 to f32", timeIt([&]() { i24_to_f32(i24, f, len); })) * 1e-6);
+	printf("  %-20s %8.0f\n", "i32 to f32", len / record("convert i32 to f32", timeIt([&]() { i32_to_f32(i32, f, len); })) * 1e-6);
+	printf("  %-20s %8.0f\n", "tpdf dither", len / record("convert tpdf dither", timeIt([&]() { tpdfDither(dither, len, &seed); })) * 1e-6);
+
+	delete[] f;
+	delete[] i16;
+	delete[] i24;
+	delete[] i32;
+	delete[] dither;
+}
+
+
+static void benchEffects() {
+	static Wave wave;
+	wave.clear();
+	for (int i = 0; i < WAVE_LEN; i++) {
+		wave.samples[i] = 2.f * i / WAVE_LEN - 1.f;
+	}
+	wave.commitSamples();
+
+	printf("Effect chain, us per wave\n");
+	const int oversamples[] = {1, 4, 8};
+	for (int oversample : oversamples) {
+		effectOversample = oversample;
+		// Every effect at once
+		for (int e = 0; e < EFFECTS_LEN; e++) {
+			wave.effects[e] = 0.3f;
+		}
+		double all = record(stringf("effects %dx all", oversample).c_str(), timeIt([&]() { wave.updatePost(); }));
+		// Only the linear effects, which never run oversampled
+		wave.effects[CHEBYSHEV] = 0.f;
+		wave.effects[SAMPLE_AND_HOLD] = 0.f;
+		wave.effects[QUANTIZATION] = 0.f;
+		double linear = record(stringf("effects %dx linear", oversample).c_str(), timeIt([&]() { wave.updatePost(); }));
+		printf("  %dx oversampling: all effects %7.2f, linear effects %7.2f\n", oversample, all * 1e6, linear * 1e6);
+	}
+	effectOversample = 1;
+}
+
+
+static void benchBank() {
+	static Bank bank;
+	bank.clear();
+	float *samples = new float[BANK_LEN * WAVE_LEN];
+	float *harmonics = new float[BANK_LEN * WAVE_LEN / 2];
+
+	Expr expr;
+	const char *text = "sin(2*pi*x + a*10*z*sin(2*pi*x*(1+b*4)))";
+	printf("Bank, us per bank\n");
+	printf("  %-24s %8.2f\n", "expression compile", record("bank expression compile", timeIt([&]() { expr.compile(text, NULL); })) * 1e6);
+	printf("  %-24s %8.2f\n", "expression evaluate", record("bank expression evaluate", timeIt([&]() { expr.evaluate(samples); })) * 1e6);
+	printf("  %-24s %8.2f\n", "setSamples", record("bank setSamples", timeIt([&]() { bank.setSamples(samples); })) * 1e6);
+
+	bank.getHarmonics(harmonics);
+	bool changed[BANK_LEN];
+	for (int j = 0; j < BANK_LEN; j++) {
+		changed[j] = true;
+	}
+	printf("  %-24s %8.2f\n", "setHarmonics", record("bank setHarmonics", timeIt([&]() { bank.setHarmonics(harmonics, changed); })) * 1e6);
+
+	static BankPlanes planes;
+	planes.load(&bank);
+	float out[WAVE_LEN];
+	printf("  %-24s %8.2f\n", "morphSpectralZ", record("bank morphSpectralZ", timeIt([&]() { planes.morphSpectralZ(12.3f, out); })) * 1e6);
+
+	delete[] samples;
+	delete[] harmonics;
+}
+
+
+/** Level in dB of what remains of `x` after removing its sinusoid at `w` radians per sample, relative to that sinusoid
+Fitting the phase makes it independent of the resampler's delay.
+*/
+static double residualDb(const float *x, int len, double w) {
+	double c = 0.0, s = 0.0;
+	for (int i = 0; i < len; i++) {
+		c += x[i] * cos(w * i);
+		s += x[i] * sin(w * i);
+	}
+	c *= 2.0 / len;
+	s *= 2.0 / len;
+	double residual = 0.0;
+	for (int i = 0; i < len; i++) {
+		double r = x[i] - c * cos(w * i) - s * sin(w * i);
+		residual += r * r;
+	}
+	double tone = (c * c + s * s) / 2.0;
+	return 10.0 * log10(residual / len / tone);
+}
+
+/** RMS level of `x` in dB relative to a full scale sinusoid */
+static double levelDb(const float *x, int len) {
+	double sum = 0.0;
+	for (int i = 0; i < len; i++) {
+		sum += (double) x[i] * x[i];
+	}
+	return 10.0 * log10(sum / len / 0.5);
+}
+
+
+static void benchResample() {
+	// One second of audio at 44.1 kHz, converted to 48 kHz
+	const int inLen = 44100;
+	const double ratio = 48000.0 / 44100.0;
+	const int outLen = inLen * ratio + 16;
+	float *in = new float[inLen];
+	float *out = new float[outLen];
+	// The error is what remains besides a 15 kHz tone after upsampling it
+	const double toneHz = 15000.0;
+	for (int i = 0; i < inLen; i++) {
+		in[i] = sinf(2 * M_PI * toneHz / 44100.0 * i);
+	}
+	// The alias is what comes out of a 23.5 kHz tone, above the new Nyquist frequency, downsampling from 48 to 44.1 kHz
+	const int aliasLen = 48000;
+	float *aliasIn = new float[aliasLen];
+	float *aliasOut = new float[aliasLen];
+	for (int i = 0; i < aliasLen; i++) {
+		aliasIn[i] = sinf(2 * M_PI * 23500.0 / 48000.0 * i);
+	}
+	// Both skip the edges, where the converters ramp in and out
+	const int edge = 1024;
+
+	printf("Resampling 44.1 to 48 kHz, x realtime, error and alias in dB\n");
+	for (int quality = 0; quality < RESAMPLE_QUALITIES_LEN; quality++) {
+		double t = record(stringf("resample %s", resampleQualityNames[quality]).c_str(), timeIt([&]() { resample(in, inLen, out, outLen, ratio, (ResampleQuality) quality); }));
+		int len = resample(in, inLen, out, outLen, ratio, (ResampleQuality) quality);
+		double error = residualDb(out + edge, len - 2 * edge, 2 * M_PI * toneHz / 48000.0);
+		len = resample(aliasIn, aliasLen, aliasOut, aliasLen, 1.0 / ratio, (ResampleQuality) quality);
+		double alias = levelDb(aliasOut + edge, len - 2 * edge);
+		printf("  %-20s %8.0f %8.1f %8.1f\n", resampleQualityNames[quality], 1.0 / t, error, alias);
+	}
+
+	delete[] in;
+	delete[] out;
+	delete[] aliasIn;
+	delete[] aliasOut;
+}
+
+
+static void benchImportPreview() {
+	// The import page resamples the audio into the whole bank and commits it every frame
+	// This times the same core calls on ten seconds of audio, zoomed to fit the bank
+	const int audioLen = 441000;
+	const int len = BANK_LEN * WAVE_LEN;
+	const double ratio = (double) len / audioLen;
+	float *audio = new float[audioLen];
+	float *samples = new float[len];
+	for (int i = 0; i < audioLen; i++) {
+		audio[i] = sinf(i * 0.05f) * 0.8f;
+	}
+	static Bank bank;
+	bank.clear();
+
+	printf("Import preview, us per frame (%.0f us at 60 fps)\n", 1e6 / 60);
+	printf("  %-20s %8s %8s\n", "", "resample", "total");
+	// Cubic while a control is dragged, sinc otherwise
+	// Every wave changes while dragging, so all of them are committed, which a still preview skips
+	const ResampleQuality qualities[] = {RESAMPLE_CUBIC, RESAMPLE_SINC_FASTEST};
+	for (ResampleQuality quality : qualities) {
+		double t = timeIt([&]() { resample(audio, audioLen, samples, len, ratio, quality); });
+		double total = record(stringf("import preview %s", resampleQualityNames[quality]).c_str(), timeIt([&]() {
+			resample(audio, audioLen, samples, len, ratio, quality);
+			bank.setSamples(samples);
+		}));
+		printf("  %-20s %8.0f %8.0f\n", resampleQualityNames[quality], t * 1e6, total * 1e6);
+	}
+
+	delete[] audio;
+	delete[] samples;
+}
+
+
+/** Streams a 16-bit stereo WAV of noise with `bytes` bytes of data, a block at a time */
+static bool writeNoiseWAV(const char *path, int64_t bytes) {
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return false;
+	uint32_t dataSize = bytes / 4 * 4;
+	uint8_t header[44];
+	memcpy(header, "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x02\0\x44\xac\0\0\x10\xb1\x02\0\x04\0\x10\0data\0\0\0\0", 44);
+	uint32_t riffSize = 36 + dataSize;
+	for (int b = 0; b < 4; b++) {
+		header[4 + b] = riffSize >> (8 * b);
+		header[40 + b] = dataSize >> (8 * b);
+	}
+	bool ok = fwrite(header, 1, 44, f) == 44;
+
+	std::vector<int16_t> block(1 << 20);
+	uint32_t seed = 1;
+	for (uint32_t written = 0; ok && written < dataSize;) {
+		for (int16_t &x : block) {
+			seed = seed * 1664525 + 1013904223;
+			x = seed >> 16;
+		}
+		uint32_t n = std::min<uint32_t>(block.size() * 2, dataSize - written);
+		ok = fwrite(block.data(), 1, n, f) == n;
+		written += n;
+	}
+	return fclose(f) == 0 && ok;
+}
+
+
+static void benchLoad() {
+	// Loading a long recording into the import page, through the memory mapped reader and through libsndfile as loadAudioPlanar() used to
+	if (loadMegabytes <= 0)
+		return;
+	std::string path = stringf("%s/bench_load.wav", tmpDir);
+	printf("Loading a %d MB 16-bit stereo WAV, MB/s\n", (int) loadMegabytes);
+	if (!writeNoiseWAV(path.c_str(), loadMegabytes << 20)) {
+		printf("  cannot write %s\n", path.c_str());
+		return;
+	}
+
+	// Both read from the page cache, since the file was just written
+	auto start = std::chrono::steady_clock::now();
+	int len = 0;
+	int channels = 0;
+	float *planes = loadWAVMapped(path.c_str(), &len, &channels);
+	double tMapped = seconds(start);
+	bool mapped = planes;
+	delete[] planes;
+	if (mapped) {
+		// Per megabyte, so baselines written at another size still compare
+		record("load mapped", tMapped / loadMegabytes);
+		printf("  %-20s %8.0f\n", "mapped", loadMegabytes / tMapped);
+	}
+	else {
+		printf("  %-20s %8s\n", "mapped", "failed");
+	}
+
+	start = std::chrono::steady_clock::now();
+	SF_INFO info;
+	memset(&info, 0, sizeof(info));
+	SNDFILE *sf = sf_open(path.c_str(), SFM_READ, &info);
+	if (sf && info.channels > 0) {
+		len = info.frames;
+		planes = new float[(int64_t) len * info.channels];
+		const int bufferLen = 1 << 12;
+		std::vector<float> buffer(bufferLen * info.channels);
+		int pos = 0;
+		while (pos < len) {
+			int frames = sf_readf_float(sf, buffer.data(), mini(bufferLen, len - pos));
+			if (frames <= 0)
+				break;
+			deinterleave(buffer.data(), frames, info.channels, planes + pos, len);
+			pos += frames;
+		}
+		double t = seconds(start);
+		delete[] planes;
+		printf("  %-20s %8.0f\n", "libsndfile", loadMegabytes / t);
+		if (mapped)
+			requireFaster("mapped load", tMapped, t);
+	}
+	else {
+		printf("  %-20s %8s\n", "libsndfile", "failed");
+	}
+	if (sf)
+		sf_close(sf);
+	remove(path.c_str());
+}
+
+
+static bool writeBaseline(const char *filename) {
+	FILE *f = fopen(filename, "w");
+	if (!f)
+		return false;
+	for (const std::pair<std::string, double> &result : results) {
+		fprintf(f, "%s\t%.6g\n", result.first.c_str(), result.second);
+	}
+	return fclose(f) == 0;
+}
+
+/** Compares the timings against a baseline and fails those which regressed. Timings missing from the baseline are skipped. */
+static bool compareBaseline(const char *filename) {
+	FILE *f = fopen(filename, "r");
+	if (!f)
+		return false;
+	std::map<std::string, double> baseline;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		char *tab = strrchr(line, '\t');
+		if (!tab)
+			continue;
+		*tab = '\0';
+		baseline[line] = atof(tab + 1);
+	}
+	fclose(f);
+
+	printf("Against %s\n", filename);
+	for (const std::pair<std::string, double> &result : results) {
+		auto it = baseline.find(result.first);
+		if (it == baseline.end() || !(it->second > 0.0))
+			continue;
+		double ratio = result.second / it->second;
+		bool ok = ratio <= regressionRatio;
+		printf("  %-32s %6.2fx time%s\n", result.first.c_str(), ratio, ok ? "" : "  FAILED");
+		if (!ok)
+			failures++;
+	}
+	return true;
+}
+
+
+int main(int argc, char **argv) {
+	const char *baseline = NULL;
+	bool write = false;
+	int arg = 1;
+	if (argc > arg + 1 && (!strcmp(argv[arg], "--baseline") || !strcmp(argv[arg], "--write"))) {
+		write = !strcmp(argv[arg], "--write");
+		baseline = argv[arg + 1];
+		arg += 2;
+	}
+	if (argc > arg)
+		tmpDir = argv[arg];
+	if (argc > arg + 1)
+		loadMegabytes = atoll(argv[arg + 1]);
+
+	printf("%d pool threads\n", poolThreads());
+	benchKernels();
+	benchConvert();
+	benchEffects();
+	benchBank();
+	benchResample();
+	benchImportPreview();
+	benchLoad();
+
+	if (baseline && write) {
+		if (!writeBaseline(baseline)) {
+			fprintf(stderr, "Could not write %s\n", baseline);
+			return 1;
+		}
+		printf("Wrote %d timings to %s\n", (int) results.size(), baseline);
+	}
+	else if (baseline && !compareBaseline(baseline)) {
+		fprintf(stderr, "Could not open %s, write it with --write\n", baseline);
+		return 1;
+	}
+	if (failures)
+		printf("%d FAILED\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,720 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+#include <sndfile.h>
+#include <chrono>
+
+
+// Unit checks of the headless core
+// Usage: core <directory for temporary files>
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	checks++; \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const char *tmpDir = ".";
+
+static std::string tmpPath(const char *name) {
+	return stringf("%s/%s", tmpDir, name);
+}
+
+static float maxError(const float *a, const float *b, int len) {
+	float error = 0.f;
+	for (int i = 0; i < len; i++) {
+		error = fmaxf(error, fabsf(a[i] - b[i]));
+	}
+	return error;
+}
+
+
+static void testKernels() {
+	const int len = 1001;
+	float x[len];
+	float ref[len];
+
+	// Chebyshev against sin(n asin(x)) in double precision, including the folded range outside [-1, 1]
+	const float ns[] = {1.f, 2.5f, 7.f, 50.f};
+	for (float n : ns) {
+		for (int i = 0; i < len; i++) {
+			x[i] = rescalef(i, 0, len - 1, -3.f, 3.f);
+			double v = (fabs(x[i]) <= 1.0) ? x[i] : 1.0 / x[i];
+			ref[i] = sin(n * asin(v));
+		}
+		effectKernels()->chebyshev(x, len, n);
+		CHECK(maxError(x, ref, len) < 1e-5f * n);
+	}
+
+	// Quantization rounds halves away from zero, like roundf()
+	for (int i = 0; i < len; i++) {
+		x[i] = rescalef(i, 0, len - 1, -1.f, 1.f);
+		ref[i] = roundf(x[i] * 8.f) * (1.f / 8.f);
+	}
+	effectKernels()->quantize(x, len, 8.f);
+	CHECK(maxError(x, ref, len) == 0.f);
+	// The largest float below a half rounds down, and floats too large for an int32 are already integers
+	float edges[4] = {0.49999997f, -0.49999997f, -2.5f, 3e9f};
+	effectKernels()->quantize(edges, 4, 1.f);
+	CHECK(edges[0] == 0.f && edges[1] == 0.f && edges[2] == -3.f && edges[3] == 3e9f);
+
+	// Sample & hold keeps a sample and repeats it for `frameskip` samples
+	for (int i = 0; i < 16; i++) {
+		x[i] = i;
+	}
+	effectKernels()->sampleAndHold(x, 16, 4.f);
+	CHECK(x[0] == 0.f && x[1] == 0.f && x[2] == 4.f && x[5] == 4.f && x[6] == 8.f);
+
+	for (int i = 0; i < len; i++) {
+		x[i] = sinf(2 * M_PI * i / len) * 0.3f + 0.1f;
+	}
+	effectKernels()->normalize(x, len);
+	float min = INFINITY, max = -INFINITY;
+	for (int i = 0; i < len; i++) {
+		min = fminf(min, x[i]);
+		max = fmaxf(max, x[i]);
+	}
+	CHECK(fabsf(min + 1.f) < 1e-6f && fabsf(max - 1.f) < 1e-6f);
+
+	for (int i = 0; i < len; i++) {
+		x[i] = 0.25f;
+	}
+	effectKernels()->normalize(x, len);
+	CHECK(x[0] == 0.f && x[len - 1] == 0.f);
+
+	for (int i = 0; i < len; i++) {
+		x[i] = rescalef(i, 0, len - 1, -2.f, 2.f);
+	}
+	effectKernels()->clip(x, len);
+	CHECK(x[0] == -1.f && x[len - 1] == 1.f && x[len / 2] == 0.f);
+
+	// The selected kernels compute the same as the generic ones, up to fused multiply-adds
+	for (int i = 0; i < len; i++) {
+		x[i] = rescalef(i, 0, len - 1, -3.f, 3.f);
+		ref[i] = x[i];
+	}
+	effectKernels()->chebyshev(x, len, 7.f);
+	genericEffectKernels()->chebyshev(ref, len, 7.f);
+	CHECK(maxError(x, ref, len) < 1e-5f);
+}
+
+
+static void testConvert() {
+	const int len = 1000;
+	float in[len];
+	float out[len];
+	for (int i = 0; i < len; i++) {
+		in[i] = rescalef(i, 0, len - 1, -1.f, 1.f);
+	}
+
+	int16_t i16[len];
+	f32_to_i16(in, i16, len);
+	CHECK(i16[0] == -0x7fff && i16[len - 1] == 0x7fff);
+	i16_to_f32(i16, out, len);
+	CHECK(maxError(in, out, len) <= 1.5f / 0x8000);
+
+	uint8_t i24[3 * len];
+	f32_to_i24(in, i24, len);
+	i24_to_f32(i24, out, len);
+	CHECK(maxError(in, out, len) <= 1.5f / 0x800000);
+	// Negative samples are sign extended
+	CHECK(out[0] < -0.999f && out[len / 4] < 0.f);
+
+	int32_t i32[len];
+	f32_to_i32(in, i32, len);
+	i32_to_f32(i32, out, len);
+	CHECK(maxError(in, out, len) <= 1e-6f);
+	// Full scale is 2^(bits - 1) - 1 for every width
+	CHECK(i32[0] == -0x7fffffff && i32[len - 1] == 0x7fffffff);
+
+	// Halves round away from zero, and the largest float below a half rounds down
+	float zeros[3] = {0.f, 0.f, 0.f};
+	float halves[3] = {0.49999997f, -2.5f, 2.5f};
+	f32_to_i16(zeros, i16, 3, halves);
+	CHECK(i16[0] == 0 && i16[1] == -3 && i16[2] == 3);
+
+	// Out-of-range samples are clamped instead of wrapping
+	float loud[2] = {2.f, -2.f};
+	f32_to_i16(loud, i16, 2);
+	CHECK(i16[0] == 0x7fff && i16[1] == -0x7fff);
+
+	// TPDF noise stays within one LSB on each side
+	float noise[len];
+	uint32_t seed = 1;
+	tpdfDither(noise, len, &seed);
+	float mean = 0.f;
+	for (int i = 0; i < len; i++) {
+		CHECK(-1.f < noise[i] && noise[i] < 1.f);
+		mean += noise[i] / len;
+	}
+	CHECK(fabsf(mean) < 0.1f);
+}
+
+
+static void testWAVReader() {
+	const int len = 500;
+	float in[len];
+	for (int i = 0; i < len; i++) {
+		in[i] = sinf(2 * M_PI * i / 100) * 0.9f;
+	}
+
+	// Integers are written with a scale of 2^(bits - 1) - 1 but read with 2^(bits - 1), which adds up to an LSB to the rounding
+	const float tolerances[EXPORT_FORMATS_LEN] = {2.f / 0x7fff, 2.f / 0x7fffff, 0.f};
+	for (int format = 0; format < EXPORT_FORMATS_LEN; format++) {
+		std::vector<uint8_t> data;
+		encodeWAV(in, len, 44100, (ExportFormat) format, data);
+		std::string path = tmpPath("reader.wav");
+		CHECK(writeFile(path.c_str(), data));
+
+		int outLen = 0;
+		int channels = 0;
+		float *out = loadWAVMapped(path.c_str(), &outLen, &channels);
+		CHECK(out != NULL);
+		if (!out)
+			continue;
+		CHECK(outLen == len && channels == 1);
+		CHECK(maxError(in, out, len) <= tolerances[format]);
+		delete[] out;
+		remove(path.c_str());
+	}
+
+	// Data sizes left unset by streaming writers
+	std::vector<uint8_t> data;
+	encodeWAV(in, len, 44100, EXPORT_PCM16, data);
+	std::string path = tmpPath("reader.wav");
+	const uint8_t unset[4] = {0xff, 0xff, 0xff, 0xff};
+	memcpy(&data[40], unset, 4);
+	CHECK(writeFile(path.c_str(), data));
+	int outLen = 0;
+	float *out = loadWAVMapped(path.c_str(), &outLen, NULL);
+	CHECK(out && outLen == len);
+	delete[] out;
+	// A size of 0 is an empty chunk, not an unset one
+	memset(&data[40], 0, 4);
+	CHECK(writeFile(path.c_str(), data));
+	CHECK(loadWAVMapped(path.c_str(), NULL, NULL) == NULL);
+	remove(path.c_str());
+
+	// Not a WAV file
+	path = tmpPath("reader.txt");
+	std::vector<uint8_t> text(100, 'x');
+	CHECK(writeFile(path.c_str(), text));
+	CHECK(loadWAVMapped(path.c_str(), NULL, NULL) == NULL);
+	remove(path.c_str());
+}
+
+
+static void put16(std::vector<uint8_t> &data, uint16_t x) {
+	data.push_back(x);
+	data.push_back(x >> 8);
+}
+
+static void put32(std::vector<uint8_t> &data, uint32_t x) {
+	put16(data, x);
+	put16(data, x >> 16);
+}
+
+/** Writes a WAV file of noise by hand, with an odd-sized LIST chunk before the data and optionally WAVE_FORMAT_EXTENSIBLE */
+static std::vector<uint8_t> noiseWAV(int tag, int bits, int channels, int frames, bool extensible) {
+	std::vector<uint8_t> data;
+	int blockAlign = channels * bits / 8;
+	uint32_t dataSize = frames * blockAlign;
+	int fmtSize = extensible ? 40 : 16;
+	// 7 bytes padded to 8, which keeps the data aligned for 32-bit samples
+	const char list[] = "LIST\x07\0\0\0INFOabc\0";
+	data.insert(data.end(), (const uint8_t*) "RIFF", (const uint8_t*) "RIFF" + 4);
+	put32(data, 4 + 8 + fmtSize + sizeof(list) - 1 + 8 + dataSize);
+	data.insert(data.end(), (const uint8_t*) "WAVEfmt ", (const uint8_t*) "WAVEfmt " + 8);
+	put32(data, fmtSize);
+	put16(data, extensible ? 0xfffe : tag);
+	put16(data, channels);
+	put32(data, 44100);
+	put32(data, 44100 * blockAlign);
+	put16(data, blockAlign);
+	put16(data, bits);
+	if (extensible) {
+		put16(data, 22);
+		put16(data, bits);
+		put32(data, 0);
+		// The subformat GUID starts with the tag, the rest is the fixed KSDATAFORMAT suffix
+		const uint8_t guid[16] = {0, 0, 0, 0, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71};
+		put16(data, tag);
+		data.insert(data.end(), guid + 2, guid + 16);
+	}
+	data.insert(data.end(), (const uint8_t*) list, (const uint8_t*) list + sizeof(list) - 1);
+	data.insert(data.end(), (const uint8_t*) "data", (const uint8_t*) "data" + 4);
+	put32(data, dataSize);
+	uint32_t seed = 1;
+	for (int i = 0; i < frames * channels; i++) {
+		seed = seed * 1664525 + 1013904223;
+		if (tag == 3) {
+			float f = (int32_t) seed * (1.f / 0x80000000u);
+			uint32_t bits32;
+			memcpy(&bits32, &f, 4);
+			put32(data, bits32);
+		}
+		else {
+			for (int b = 4 - bits / 8; b < 4; b++) {
+				data.push_back(seed >> (8 * b));
+			}
+		}
+	}
+	return data;
+}
+
+/** The mapped reader has to decode every file it accepts exactly like the libsndfile path it bypasses */
+static void testWAVReaderMatchesSndfile() {
+	const int frames = 1000;
+	struct Case {
+		int tag, bits, channels;
+		bool extensible;
+	};
+	const Case cases[] = {
+		{1, 16, 1, false},
+		{1, 16, 2, true},
+		{1, 24, 1, false},
+		{1, 24, 2, false},
+		{1, 24, 3, true},
+		{1, 32, 2, false},
+		{3, 32, 1, false},
+		{3, 32, 2, true},
+	};
+	for (const Case &c : cases) {
+		std::string path = tmpPath("compare.wav");
+		CHECK(writeFile(path.c_str(), noiseWAV(c.tag, c.bits, c.channels, frames, c.extensible)));
+
+		int len = 0;
+		int channels = 0;
+		float *planes = loadWAVMapped(path.c_str(), &len, &channels);
+		CHECK(planes && len == frames && channels == c.channels);
+
+		SF_INFO info;
+		memset(&info, 0, sizeof(info));
+		SNDFILE *sf = sf_open(path.c_str(), SFM_READ, &info);
+		CHECK(sf && info.frames == frames && info.channels == c.channels);
+		if (planes && sf && info.frames == frames && info.channels == c.channels) {
+			std::vector<float> interleaved(frames * c.channels);
+			CHECK(sf_readf_float(sf, interleaved.data(), frames) == frames);
+			float error = 0.f;
+			for (int i = 0; i < frames; i++) {
+				for (int ch = 0; ch < c.channels; ch++) {
+					error = fmaxf(error, fabsf(planes[ch * frames + i] - interleaved[i * c.channels + ch]));
+				}
+			}
+			CHECK(error <= 1.f / (1 << 24));
+		}
+		if (sf)
+			sf_close(sf);
+		delete[] planes;
+		remove(path.c_str());
+	}
+}
+
+
+static void testWavetable() {
+	const int len = 600;
+	float in[len];
+	for (int i = 0; i < len; i++) {
+		in[i] = sinf(2 * M_PI * i / 256);
+	}
+	std::vector<uint8_t> data;
+	encodeWAV(in, len, 44100, EXPORT_FLOAT, data);
+	std::string path = tmpPath("wavetable.wav");
+	CHECK(writeFile(path.c_str(), data));
+
+	// Two whole frames, and the partial third is dropped
+	Wavetable wavetable;
+	CHECK(wavetable.loadWAV(path.c_str(), 256));
+	CHECK(wavetable.bankLen == 2 && wavetable.samples[256 + 64] == in[256 + 64]);
+	// Shorter than one frame
+	CHECK(!wavetable.loadWAV(path.c_str(), 1024));
+	CHECK(wavetable.bankLen == 0 && wavetable.samples == NULL);
+	remove(path.c_str());
+	CHECK(!wavetable.loadWAV(path.c_str(), 256));
+}
+
+
+static void testExportLibrary() {
+	float *samples = new float[BANK_LEN * WAVE_LEN];
+	for (int i = 0; i < BANK_LEN * WAVE_LEN; i++) {
+		samples[i] = sinf(2 * M_PI * i / WAVE_LEN) * 0.5f;
+	}
+	std::vector<uint8_t> data;
+	encodeWAV(samples, BANK_LEN * WAVE_LEN, 44100, EXPORT_FLOAT, data);
+	std::vector<std::string> paths;
+	paths.push_back(tmpPath("bank.wav"));
+	paths.push_back(tmpPath((std::string(120, 'x') + ".wav").c_str()));
+	for (const std::string &path : paths) {
+		CHECK(writeFile(path.c_str(), data));
+	}
+
+	// Names over 100 bytes do not fit a tar header
+	std::string tarPath = tmpPath("library.tar");
+	ExportStats stats = exportLibrary(paths, tarPath.c_str(), EXPORT_PCM16, true);
+	int64_t entrySize = (44 + 2 * BANK_LEN * WAVE_LEN + 511) / 512 * 512;
+	CHECK(stats.files == 1 && stats.bytes == 512 + entrySize + 1024);
+	remove(tarPath.c_str());
+
+	// Exporting into the same folder leaves the banks alone
+	stats = exportLibrary(paths, tmpDir, EXPORT_PCM16, false);
+	CHECK(stats.files == 0);
+	int len = 0;
+	float *loaded = loadAudio(paths[0].c_str(), &len);
+	CHECK(loaded && len == BANK_LEN * WAVE_LEN && loaded[1] == samples[1]);
+	delete[] loaded;
+	stats = exportWavetableLibrary(paths, tmpDir, wavetableGeometries[0], EXPORT_PCM16, false);
+	CHECK(stats.files == 0);
+	loaded = loadAudio(paths[0].c_str(), &len);
+	CHECK(loaded && len == BANK_LEN * WAVE_LEN && loaded[1] == samples[1]);
+	delete[] loaded;
+
+	for (const std::string &path : paths) {
+		remove(path.c_str());
+	}
+	delete[] samples;
+}
+
+
+static void testExpr() {
+	Expr expr;
+	std::string error;
+	float *out = new float[BANK_LEN * WAVE_LEN];
+
+	CHECK(expr.compile("sin(2*pi*x) * (1 - z)", &error));
+	expr.evaluate(out);
+	float e = 0.f;
+	for (int j = 0; j < BANK_LEN; j++) {
+		for (int i = 0; i < WAVE_LEN; i++) {
+			float ref = sinf(2 * M_PI * i / WAVE_LEN) * (1.f - (float) j / (BANK_LEN - 1));
+			e = fmaxf(e, fabsf(out[j * WAVE_LEN + i] - ref));
+		}
+	}
+	CHECK(e < 1e-5f);
+
+	// Constants fold into one instruction
+	CHECK(expr.compile("2 * (3 + 4) ^ 2", &error));
+	CHECK(expr.ops.size() == 1 && expr.ops[0].value == 98.f);
+	CHECK(expr.compile("-x^2", &error));
+	expr.evaluate(out);
+	CHECK(out[WAVE_LEN / 2] == -0.25f);
+
+	// Parameters
+	CHECK(expr.compile("a + b", &error));
+	expr.params[0] = 0.25f;
+	expr.params[1] = 0.5f;
+	expr.evaluate(out);
+	CHECK(out[0] == 0.75f);
+
+	// Non-finite results become 0
+	CHECK(expr.compile("1 / x", &error));
+	expr.evaluate(out);
+	CHECK(out[0] == 0.f);
+
+	// A failed compile keeps the previous program
+	CHECK(!expr.compile("sin(x", &error));
+	CHECK(!error.empty());
+	CHECK(expr.ops.size() == 3);
+	CHECK(!expr.compile("foo(x)", &error));
+	CHECK(!expr.compile("x x", &error));
+	CHECK(!expr.compile("", &error));
+	// Bytes of UTF-8 text are negative chars where char is signed
+	CHECK(!expr.compile("x * \xcf\x80", &error));
+
+	delete[] out;
+}
+
+
+static void testArena() {
+	void *a;
+	{
+		ArenaScope scope;
+		a = arenaAlloc(100);
+		CHECK(((uintptr_t) a) % 32 == 0);
+		void *b = arenaAlloc(1, 64);
+		CHECK(((uintptr_t) b) % 64 == 0);
+		CHECK(b != a);
+	}
+	// The scope released both allocations
+	{
+		ArenaScope scope;
+		CHECK(arenaAlloc(100) == a);
+	}
+	// Allocations larger than a block spill into a new one
+	{
+		ArenaScope scope;
+		float *big = arenaArray<float>(1 << 20);
+		big[(1 << 20) - 1] = 1.f;
+		CHECK(big != NULL);
+	}
+	arenaReset();
+
+	// Tasks which leave allocations behind do not grow the workers' arenas
+	arenaFrameEnd();
+	TaskGroup group;
+	for (int i = 0; i < 100; i++) {
+		group.run([]() {
+			float *leak = arenaArray<float>(1 << 18);
+			leak[0] = 1.f;
+		});
+	}
+	group.wait();
+	arenaFrameEnd();
+	CHECK(arenaFrameStats.heapAllocations <= poolThreads());
+}
+
+
+static void testPool() {
+	const int len = 10000;
+	std::vector<int> counts(len, 0);
+	parallelFor(0, len, [&](int i) {
+		counts[i]++;
+	});
+	bool once = true;
+	for (int i = 0; i < len; i++) {
+		once = once && counts[i] == 1;
+	}
+	CHECK(once);
+
+	// Groups nest without deadlocking
+	std::atomic<int> sum(0);
+	parallelFor(0, 16, [&](int i) {
+		parallelFor(0, 16, [&](int j) {
+			sum += i * j;
+		});
+	});
+	CHECK(sum == 120 * 120);
+
+	TaskGroup group;
+	std::atomic<int> ran(0);
+	for (int i = 0; i < 100; i++) {
+		group.run([&]() { ran++; });
+	}
+	group.wait();
+	CHECK(ran == 100);
+
+	// The waiting thread sleeps until tasks running on the workers are done
+	ran = 0;
+	for (int i = 0; i < 4; i++) {
+		group.run([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			ran++;
+		});
+	}
+	group.wait();
+	CHECK(ran == 4);
+}
+
+
+static void testLattice() {
+	static Bank bank;
+	bank.clear();
+	float *samples = new float[BANK_LEN * WAVE_LEN];
+	for (int j = 0; j < BANK_LEN; j++) {
+		for (int i = 0; i < WAVE_LEN; i++) {
+			samples[j * WAVE_LEN + i] = sinf(2 * M_PI * i / WAVE_LEN * (j % 5 + 1)) * 0.5f;
+		}
+	}
+	bank.setSamples(samples);
+
+	latticeInit();
+	latticeUpdate(&bank);
+	// Lattice frames at a step match the direct spectral morph, once the builder has published them
+	const float z = 3.25f;
+	float frame[WAVE_LEN];
+	bool ready = false;
+	for (int t = 0; t < 1000 && !ready; t++) {
+		ready = latticeMorphZ(z, frame);
+		if (!ready)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(ready);
+	static BankPlanes planes;
+	planes.load(&bank);
+	float direct[WAVE_LEN];
+	planes.morphSpectralZ(z, direct);
+	CHECK(maxError(frame, direct, WAVE_LEN) < 1e-5f);
+
+	// An edit unpublishes the segments around the wave until they are rebuilt
+	bank.waves[3].commitSamples();
+	latticeUpdate(&bank);
+	latticeDestroy();
+	delete[] samples;
+}
+
+
+/** Runs last, since the workers do not come back */
+static void testPoolDestroy() {
+	std::atomic<int> ran(0);
+	TaskGroup group;
+	for (int i = 0; i < 100; i++) {
+		group.run([&]() { ran++; });
+	}
+	poolDestroy();
+	CHECK(ran == 100 && group.pending == 0);
+
+	// Tasks submitted afterwards run on the waiting thread
+	for (int i = 0; i < 10; i++) {
+		group.run([&]() { ran++; });
+	}
+	group.wait();
+	CHECK(ran == 110);
+}
+
+
+static void testBank() {
+	static Bank bank;
+	bank.clear();
+	float *samples = new float[BANK_LEN * WAVE_LEN];
+	for (int j = 0; j < BANK_LEN; j++) {
+		for (int i = 0; i < WAVE_LEN; i++) {
+			samples[j * WAVE_LEN + i] = sinf(2 * M_PI * i / WAVE_LEN * (j + 1)) * 0.5f;
+		}
+	}
+	bank.setSamples(samples);
+	float *post = new float[BANK_LEN * WAVE_LEN];
+	bank.getPostSamples(post);
+	CHECK(maxError(samples, post, BANK_LEN * WAVE_LEN) < 1e-6f);
+
+	// Harmonics round trip, and only the changed waves are touched
+	const int harmonicsLen = BANK_LEN * WAVE_LEN / 2;
+	float *harmonics = new float[harmonicsLen];
+	bank.getHarmonics(harmonics);
+	CHECK(fabsf(harmonics[1] - 0.5f) < 1e-5f);
+	uint32_t version0 = bank.waves[0].version;
+	uint32_t version1 = bank.waves[1].version;
+	bool changed[BANK_LEN] = {};
+	changed[1] = true;
+	harmonics[WAVE_LEN / 2 + 2] = 0.25f;
+	harmonics[WAVE_LEN / 2 + 5] = 0.125f;
+	bank.setHarmonics(harmonics, changed);
+	CHECK(bank.waves[0].version == version0);
+	CHECK(bank.waves[1].version != version1);
+	float *after = new float[harmonicsLen];
+	bank.getHarmonics(after);
+	CHECK(maxError(harmonics, after, harmonicsLen) < 1e-5f);
+
+	// Save and load round trip, and a failed save reports it
+	std::string path = tmpPath("bank.dat");
+	CHECK(bank.save(path.c_str()));
+	static Bank loaded;
+	loaded.load(path.c_str());
+	loaded.getPostSamples(post);
+	CHECK(memcmp(post, bank.waves[0].postSamples, sizeof(float) * WAVE_LEN) == 0);
+	remove(path.c_str());
+	CHECK(!bank.save(tmpPath("missing/bank.dat").c_str()));
+
+	// PCM16 WAV export of every wave
+	path = tmpPath("bank.wav");
+	bank.saveWAV(path.c_str());
+	int wavLen = 0;
+	float *wav = loadWAVMapped(path.c_str(), &wavLen, NULL);
+	CHECK(wav && wavLen == BANK_LEN * WAVE_LEN);
+	if (wav) {
+		bank.getPostSamples(samples);
+		CHECK(maxError(samples, wav, BANK_LEN * WAVE_LEN) <= 2.f / 0x7fff);
+	}
+	delete[] wav;
+	remove(path.c_str());
+
+	// Versions
+	static Bank copy;
+	copy = bank;
+	CHECK(copy.sameVersions(&bank));
+	copy.waves[3].commitSamples();
+	CHECK(!copy.sameVersions(&bank));
+
+	delete[] samples;
+	delete[] post;
+	delete[] harmonics;
+	delete[] after;
+}
+
+
+static void testKeyframes() {
+	const int rows = WAVE_LEN / 2;
+	float *matrix = new float[BANK_LEN * rows];
+	for (int j = 0; j < BANK_LEN; j++) {
+		for (int i = 0; i < rows; i++) {
+			matrix[j * rows + i] = (j == 2) ? 1.f : (j == 6) ? 0.5f * i / rows : -1.f;
+		}
+	}
+	bool keyframes[BANK_LEN] = {};
+	bool changed[BANK_LEN] = {};
+
+	// Without keyframes nothing is filled
+	interpolateKeyframes(matrix, keyframes, changed);
+	bool any = false;
+	for (int j = 0; j < BANK_LEN; j++) {
+		any = any || changed[j];
+	}
+	CHECK(!any && matrix[0] == -1.f);
+
+	keyframes[2] = true;
+	keyframes[6] = true;
+	interpolateKeyframes(matrix, keyframes, changed);
+	float e = 0.f;
+	for (int j = 0; j < BANK_LEN; j++) {
+		for (int i = 0; i < rows; i++) {
+			float b = 0.5f * i / rows;
+			// Before the first and after the last keyframe, the nearest one is held
+			float ref = (j <= 2) ? 1.f : (j >= 6) ? b : crossf(1.f, b, (j - 2) / 4.f);
+			e = fmaxf(e, fabsf(matrix[j * rows + i] - ref));
+		}
+	}
+	CHECK(e < 1e-6f);
+	// Keyframes themselves are left alone
+	CHECK(changed[0] && changed[1] && !changed[2] && changed[4] && !changed[6] && changed[BANK_LEN - 1]);
+
+	delete[] matrix;
+}
+
+
+static void testResample() {
+	// One cycle resampled up and back keeps a band-limited wave
+	float in[WAVE_LEN];
+	for (int i = 0; i < WAVE_LEN; i++) {
+		in[i] = sinf(2 * M_PI * i / WAVE_LEN) + 0.5f * cosf(2 * M_PI * 3 * i / WAVE_LEN);
+	}
+	float up[WAVE_LEN * 4];
+	float down[WAVE_LEN];
+	cyclicResample(in, WAVE_LEN, up, WAVE_LEN * 4);
+	CHECK(fabsf(up[4] - in[1]) < 1e-5f);
+	cyclicResample(up, WAVE_LEN * 4, down, WAVE_LEN);
+	CHECK(maxError(in, down, WAVE_LEN) < 1e-5f);
+
+	// The cubic interpolator reproduces a ramp exactly, away from the held end samples
+	float ramp[WAVE_LEN];
+	for (int i = 0; i < WAVE_LEN; i++) {
+		ramp[i] = (float) i / WAVE_LEN;
+	}
+	CHECK(resample(ramp, WAVE_LEN, up, WAVE_LEN * 4, 2.0, RESAMPLE_CUBIC) == WAVE_LEN * 2);
+	CHECK(fabsf(up[101] - 50.5f / WAVE_LEN) < 1e-6f);
+}
+
+
+int main(int argc, char **argv) {
+	if (argc > 1)
+		tmpDir = argv[1];
+
+	testKernels();
+	testConvert();
+	testWAVReader();
+	testWAVReaderMatchesSndfile();
+	testWavetable();
+	testExportLibrary();
+	testExpr();
+	testArena();
+	testPool();
+	testBank();
+	testKeyframes();
+	testResample();
+	testLattice();
+	testPoolDestroy();
+
+	printf("%d checks, %d failed (%s kernels, %s conversions)\n", checks, failures, effectKernels()->name, convertKernels()->name);
+	return failures ? 1 : 0;
+}
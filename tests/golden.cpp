@@ -0,0 +1,154 @@
+#include "WaveEdit.hpp"
+#include <string.h>
+
+
+// Regression test of the effect chain against the reference in tests/golden
+// Usage: golden <reference>, or golden --write <reference> after an intended change to the output, explaining the change in the commit.
+
+/** Waves with only one effect enabled, per effect */
+static const int SINGLE_LEN = 32;
+/** Waves with random mixes of effects, at 1x and at 4x oversampling */
+static const int MIXED_LEN = 192;
+static const int OVERSAMPLED_LEN = 128;
+static const int CORPUS_LEN = EFFECTS_LEN * SINGLE_LEN + MIXED_LEN + OVERSAMPLED_LEN;
+
+enum {
+	CLASS_MIXED = EFFECTS_LEN,
+	CLASS_OVERSAMPLED,
+	CLASSES_LEN
+};
+
+/** Largest sample error allowed against the reference, which was written with a different FFT and libm than the one under test */
+static const float singleTolerance = 1e-4;
+/** Mixes can stack Chebyshev folding on top of normalization, which amplifies rounding differences */
+static const float mixedTolerance = 1e-3;
+/** Quantization and sample & hold round to steps, so a sample sitting on a step can land on either side with a different FFT.
+A class fails if more than 1 in this many waves is outside the tolerance.
+*/
+static const int outlierRatio = 32;
+
+
+/** xorshift32, so the corpus does not depend on the platform's rand() */
+static uint32_t seed = 0x2545f491;
+
+static float random01() {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return (seed >> 8) * (1.f / (1 << 24));
+}
+
+
+static int waveClass(int n) {
+	if (n < EFFECTS_LEN * SINGLE_LEN)
+		return n % EFFECTS_LEN;
+	if (n < EFFECTS_LEN * SINGLE_LEN + MIXED_LEN)
+		return CLASS_MIXED;
+	return CLASS_OVERSAMPLED;
+}
+
+static const char *className(int c) {
+	if (c < EFFECTS_LEN)
+		return effectNames[c];
+	return c == CLASS_MIXED ? "Mixed" : "Mixed, 4x oversampled";
+}
+
+
+/** Builds the corpus and runs each wave through the effect chain */
+static void render(float *out) {
+	static Wave waves[CORPUS_LEN];
+	for (int n = 0; n < CORPUS_LEN; n++) {
+		Wave *wave = &waves[n];
+		wave->clear();
+		// Sine, saw, square and noise inputs, cycling through all four for each effect
+		int shape = (n / EFFECTS_LEN) % 4;
+		for (int i = 0; i < WAVE_LEN; i++) {
+			float p = (float) i / WAVE_LEN;
+			float noise = 2.f * random01() - 1.f;
+			wave->samples[i] = shape == 0 ? sinf(2 * M_PI * p) : shape == 1 ? 2.f * p - 1.f : shape == 2 ? (p < 0.5f ? 1.f : -1.f) : noise;
+		}
+		int c = waveClass(n);
+		if (c < EFFECTS_LEN) {
+			wave->effects[c] = random01();
+		}
+		else {
+			for (int e = 0; e < EFFECTS_LEN; e++) {
+				float amount = random01();
+				wave->effects[e] = (random01() < 0.5f) ? amount : 0.f;
+			}
+			wave->cycle = random01() < 0.5f;
+			wave->normalize = random01() < 0.5f;
+		}
+	}
+
+	for (int n = 0; n < CORPUS_LEN; n++) {
+		effectOversample = (waveClass(n) == CLASS_OVERSAMPLED) ? 4 : 1;
+		waves[n].commitSamples();
+		memcpy(&out[n * WAVE_LEN], waves[n].postSamples, sizeof(float) * WAVE_LEN);
+	}
+	effectOversample = 1;
+}
+
+
+int main(int argc, char **argv) {
+	bool write = (argc == 3 && !strcmp(argv[1], "--write"));
+	if (argc != 2 && !write) {
+		fprintf(stderr, "usage: %s [--write] <reference>\n", argv[0]);
+		return 2;
+	}
+	const char *filename = argv[argc - 1];
+
+	float *out = new float[CORPUS_LEN * WAVE_LEN];
+	render(out);
+
+	if (write) {
+		FILE *f = fopen(filename, "wb");
+		if (!f || fwrite(out, sizeof(float), CORPUS_LEN * WAVE_LEN, f) != (size_t) CORPUS_LEN * WAVE_LEN || fclose(f)) {
+			fprintf(stderr, "Could not write %s\n", filename);
+			return 1;
+		}
+		printf("Wrote %d waves to %s\n", CORPUS_LEN, filename);
+		return 0;
+	}
+
+	float *ref = new float[CORPUS_LEN * WAVE_LEN];
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		fprintf(stderr, "Could not open %s\n", filename);
+		return 1;
+	}
+	size_t len = fread(ref, sizeof(float), CORPUS_LEN * WAVE_LEN, f);
+	bool extra = fgetc(f) != EOF;
+	fclose(f);
+	if (len != (size_t) CORPUS_LEN * WAVE_LEN || extra) {
+		fprintf(stderr, "%s does not have %d waves, rewrite it with --write\n", filename, CORPUS_LEN);
+		return 1;
+	}
+
+	float maxErrors[CLASSES_LEN] = {};
+	int outliers[CLASSES_LEN] = {};
+	int counts[CLASSES_LEN] = {};
+	for (int n = 0; n < CORPUS_LEN; n++) {
+		int c = waveClass(n);
+		float error = 0.f;
+		for (int i = 0; i < WAVE_LEN; i++) {
+			error = fmaxf(error, fabsf(out[n * WAVE_LEN + i] - ref[n * WAVE_LEN + i]));
+		}
+		float tolerance = (c < EFFECTS_LEN) ? singleTolerance : mixedTolerance;
+		if (!(error <= tolerance))
+			outliers[c]++;
+		maxErrors[c] = fmaxf(maxErrors[c], error);
+		counts[c]++;
+	}
+
+	int failed = 0;
+	for (int c = 0; c < CLASSES_LEN; c++) {
+		bool ok = outliers[c] * outlierRatio <= counts[c];
+		printf("%-24s max error %-10.3g outliers %d/%d%s\n", className(c), maxErrors[c], outliers[c], counts[c], ok ? "" : "  FAILED");
+		if (!ok)
+			failed++;
+	}
+	delete[] out;
+	delete[] ref;
+	return failed ? 1 : 0;
+}